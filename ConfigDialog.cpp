@@ -1,4 +1,5 @@
 #include "ConfigDialog.h"
+#include "Detector.h"
 #include <filesystem>
 #include <fstream>
 #include <ranges>
@@ -86,6 +87,16 @@ auto ConfigDialog::fillParamFromEdit() -> void
 		}
 	}
 
+	// Get the selected item from the detector combo box
+	auto hDetectorComboBox = GetDlgItem(IDC_COMBO3);
+	if(hDetectorComboBox){
+	    auto x = SendMessageA(hDetectorComboBox, CB_GETCURSEL, 0, 0);
+		logInfo("Detector combo box value: ", x);
+		if (x>=0 and x<(LRESULT)DetectorRegistry::instance().names().size()){
+			params[11] = (int)x ;
+		}
+	}
+
 }
 
 auto ConfigDialog::onInit() -> void
@@ -121,6 +132,18 @@ auto ConfigDialog::onInit() -> void
 		SendMessage(hSkinComboBox, CB_ADDSTRING, 0, (LPARAM)"Sebas");
 		SendMessageA(hSkinComboBox, CB_SETCURSEL, params[7], 0);
 	}
+	auto hDetectorComboBox = GetDlgItem(IDC_COMBO3);
+	if(hDetectorComboBox){
+		logInfo("Detector combo box setup");
+		SendMessage(hDetectorComboBox, CB_RESETCONTENT, 0, 0); // Clear any existing items
+
+		// registry order is the index stored in the config
+		for (const auto &name : DetectorRegistry::instance().names())
+		{
+			SendMessageA(hDetectorComboBox, CB_ADDSTRING, 0, (LPARAM)name.c_str());
+		}
+		SendMessageA(hDetectorComboBox, CB_SETCURSEL, params[11], 0);
+	}
 
 }
 
@@ -141,7 +164,7 @@ auto ConfigDialog::handleCommand(UINT message, WPARAM wParam, LPARAM lParam) ->
 		endDialog(wParam);
 		return TRUE;
 	case IDC_RESET:
-		params = {430, 100, 430, 100, 25, 520, 1, 0};
+		params = {430, 100, 430, 100, 25, 520, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 		onInit();
 		return TRUE;
 	default:
@@ -203,3 +226,40 @@ auto ConfigDialog::ScreenCaptureMethod() const -> int {
 auto ConfigDialog::UISkin () const -> int {
 	return params[7];
 }
+
+auto ConfigDialog::PyramidFactor() const -> int {
+	return params[8];
+}
+
+auto ConfigDialog::PredictWindows() const -> int {
+	return params[9];
+}
+
+auto ConfigDialog::AnisotropicFactor() const -> int {
+	return params[10];
+}
+
+auto ConfigDialog::DetectorIndex() const -> int {
+	return params[11];
+}
+
+auto ConfigDialog::NativeResolution() const -> int {
+	return params[12];
+}
+
+auto ConfigDialog::DetectCores() const -> uint64_t {
+	// the int parameter holds the mask of cores 0-31
+	return uint32_t(params[13]);
+}
+
+auto ConfigDialog::DetectScheduling() const -> int {
+	return params[14];
+}
+
+auto ConfigDialog::FramePeriod() const -> int {
+	return params[15];
+}
+
+auto ConfigDialog::PacingMode() const -> int {
+	return params[16];
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "BaseDialog.h"
 #include <array>
+#include <cstdint>
 
 
 // ConfigDialog class
@@ -13,7 +14,7 @@ class ConfigDialog : public BaseDialog<ConfigDialog>
 {
 private:
 	using BaseDialog::BaseDialog;
-	std::array<int, 8> params = {430, 100, 430, 100, 25, 520, 1, 0};
+	std::array<int, 17> params = {430, 100, 430, 100, 25, 520, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 	std::string configFile;
 
 	/**
@@ -113,4 +114,81 @@ public:
 	 * @return 0 for Don Raul skin, 1 .., 2..
 	 */
 	auto UISkin () const -> int;
+
+	/**
+	 * @brief Gets the pyramid factor of coarse-to-fine lane matching
+	 * Only editable in the config file
+	 *
+	 * @return 0 for full resolution matching, 2 or 4 for matching at 1/2 or 1/4 scale first
+	 */
+	auto PyramidFactor() const -> int;
+
+	/**
+	 * @brief Gets how much of each lane is matched between full matches, see WindowMode
+	 * Only editable in the config file
+	 *
+	 * @return 0 for full lane matching every frame, 1 for predicted windows,
+	 * 2 for tracks moved by the estimated global scroll with matching only near the lane entry and exit
+	 */
+	auto PredictWindows() const -> int;
+
+	/**
+	 * @brief Gets the horizontal reduction factor of anisotropic lane matching
+	 * Only editable in the config file
+	 *
+	 * @return 0 for uniform matching, 2..4 to match lanes at 1/factor width and full height
+	 */
+	auto AnisotropicFactor() const -> int;
+
+	/**
+	 * @brief Gets the selected detector
+	 *
+	 * @return Index in DetectorRegistry: 0 auto (calibrated spatial/FFT), 1 OpenCV NCC, 2 spatial, 3 FFT,
+	 * 4 sparse sample points, 5 binary popcount, 6 background blobs, 7 cascade, 8 row projection, 9 template bank
+	 */
+	auto DetectorIndex() const -> int;
+
+	/**
+	 * @brief Gets whether frames are matched at their captured resolution
+	 * Only editable in the config file
+	 *
+	 * @return 0 to resize every frame to the 373 px reference width, 1 to scale the templates
+	 * and the lane geometry once per capture size and match without resizing
+	 */
+	auto NativeResolution() const -> int;
+
+	/**
+	 * @brief Gets the cores of the detection, capture and input threads
+	 * Only editable in the config file; the worker pool gets the other cores.
+	 * The file stores the mask as a 32-bit int, so only cores 0-31 can be set there
+	 * (core 31 as a negative value); use --cores for higher cores
+	 *
+	 * @return Core mask, bit i for core i; 0 to let the threads float over all cores
+	 */
+	auto DetectCores() const -> uint64_t;
+
+	/**
+	 * @brief Gets the scheduling class of the detection, capture and input threads
+	 * Only editable in the config file
+	 *
+	 * @return SchedulingClass: 0 normal, 1 high, 2 realtime where permitted
+	 */
+	auto DetectScheduling() const -> int;
+
+	/**
+	 * @brief Gets the target capture period
+	 * Only editable in the config file
+	 *
+	 * @return Period in ms; 0 for the default 45 ms
+	 */
+	auto FramePeriod() const -> int;
+
+	/**
+	 * @brief Gets what starts a capture
+	 * Only editable in the config file
+	 *
+	 * @return PacingMode: 0 every frame period, 1 when the desktop presents a new frame
+	 * (desktop duplication only, the period otherwise)
+	 */
+	auto PacingMode() const -> int;
 };
@@ -118,9 +118,12 @@ auto DesktopDuplicationCapture::CaptureNext(const RECT& region) ->bool{
 
     IDXGIResource* deskRes = nullptr;
     DXGI_OUTDUPL_FRAME_INFO frameInfo;
-    hr = DeskDupl->AcquireNextFrame(0, &frameInfo, &deskRes);
+    hr = DeskDupl->AcquireNextFrame(FrameTimeout, &frameInfo, &deskRes);
     if (hr == DXGI_ERROR_WAIT_TIMEOUT){
-        logInfo("AcquireNextFrame timeout");
+        // a static screen times out every wait; the capture loop counts them in the pacing stats
+        if (LogToFile::getInstance().getVerboseLevel() >= 2) {
+            logInfo("AcquireNextFrame timeout");
+        }
         return false;
     } 
     if (FAILED(hr)) {
@@ -192,4 +195,9 @@ auto DesktopDuplicationCapture::grabScreen(RECT region) ->std::optional<cv::Mat>
     return cv::Mat(Latest.Height, Latest.Width, CV_8UC4, (void*)Latest.Buf.data()).clone();
 }
 
+auto DesktopDuplicationCapture::setFrameWait(int timeoutMs) -> bool {
+    FrameTimeout = UINT(std::max(timeoutMs, 0));
+    return true;
+}
+
 
@@ -38,6 +38,13 @@ public:
      */
     std::optional<cv::Mat> grabScreen(RECT region) override;
 
+    /**
+     * @brief Makes AcquireNextFrame wait until the desktop presents a new frame.
+     * @param timeoutMs Longest wait of a grab.
+     * @return Always true.
+     */
+    auto setFrameWait(int timeoutMs) -> bool override;
+
 private:
     /**
      * @brief Initializes the Desktop Duplication API.
@@ -62,6 +69,7 @@ private:
     ID3D11DeviceContext* D3DDeviceContext = nullptr; ///< Pointer to the ID3D11DeviceContext interface.
     DXGI_OUTPUT_DESC OutputDesc; ///< Description of the output display.
     bool HaveFrameLock = false; ///< Indicates if the frame is locked.
+    UINT FrameTimeout = 0; ///< AcquireNextFrame timeout in ms, 0 to return at once.
 
     /**
      * @struct FrameData
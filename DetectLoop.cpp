@@ -1,17 +1,43 @@
 #include "DetectLoop.h"
 #include "WinApiScreenCapture.h"
 #include "DesktopDuplicateCapture.h"
+#include <bit>
 #include <filesystem>
 #include <fstream>
 #include <optional>
 #include <opencv2/core/ocl.hpp>
 #include <stop_token>
 #include "NaiveTracker.h"
+#include "Detector.h"
+#include "SpscRing.h"
+#include "TaskGraph.h"
+#include "WorkerPool.h"
 
 constexpr int MINIMUM_LINE_LENGTH = 170;
 constexpr int BORDER_MATCH_COUNT = 7;
+// frames are matched at this width unless NativeResolution is set; the geometry below is tuned for it
+constexpr double REFERENCE_WIDTH = 373.0;
 constexpr int DETECT_AREA_HEIGHT = 98;
 constexpr double NO_OCCULSION_THRESHOLD = 0.55;
+// weaker matches only follow objects already tracked, see NaiveTracker::setSpawnScore
+constexpr double DETECTION_THRESHOLD = 0.45;
+// predicted-window matching, in reference pixels
+constexpr int WINDOW_MARGIN = 12;
+constexpr int ENTRY_BAND_HEIGHT = 40;
+constexpr int FULL_MATCH_PERIOD = 15;
+// bottom Y band above the exit line where scroll-propagated tracks are verified
+constexpr int VERIFY_BAND_HEIGHT = 40;
+
+/**
+ * @brief Lane geometry of the reference width, scaled to the matched frame.
+ */
+struct MatchGeometry
+{
+    double scale = 1.0; ///< Matched frame pixels per reference pixel
+
+    // positive lengths stay at least one pixel
+    auto scaled(int reference) const -> int { return std::max(reference > 0 ? 1 : 0, int(std::lround(reference * scale))); }
+};
 
 // Function to check if two borders are within a certain limit
 auto withinLimit(const RECT &border1, const RECT &border2) -> bool
@@ -23,50 +49,6 @@ auto withinLimit(const RECT &border1, const RECT &border2) -> bool
             abs(border1.bottom - border2.bottom) < LIMIT);
 }
 
-auto getLocationsBottomY(const cv::Mat &result, int height, int exitArea, float threshold = NO_OCCULSION_THRESHOLD) -> std::vector<int>
-{
-    std::vector<int> locations;
-    constexpr int dispY = 17;
-    locations.reserve(50);
-    float last_thresh = 0;
-    int lastY = 0; 
-    for (int y = 0; y < result.rows; ++y)
-    {
-        for (int x = 0; x < result.cols; ++x)
-        {
-            auto thresh = result.at<float>(y, x);
-            if (thresh >= threshold)
-            {
-                // do not match
-                if(y>exitArea) {
-                    continue;
-                }
-                if (std::abs(y - lastY) > dispY)
-                {
-                    locations.emplace_back(y + height);
-                    lastY = y;
-                    last_thresh = thresh;
-                }
-                else
-                {
-                    if (thresh > last_thresh)
-                    {  
-
-                        if(locations.size()>0){
-                            locations.back() = y + height;
-                        }else{
-                            locations.emplace_back(y + height);
-                        }
-                        lastY = y;
-                        last_thresh = thresh;
-                    }
-                }
-            }
-        }
-    }
-    return locations;
-}
-
 auto doubleRectCoords(const std::optional<RECT> &rectOpt) -> std::optional<RECT>
 {
     if (rectOpt.has_value())
@@ -107,23 +89,334 @@ RECT adjustWithClamp(const RECT& rect, const RECT& border)
     return adjusted;
 }
 
+// default capture period, the period of the stats log and the longest wait for a new frame, in ms
+constexpr int FRAME_PERIOD = 45;
+constexpr int STATS_PERIOD = 10000;
+constexpr int FRAME_WAIT_TIMEOUT = 100;
+
+// applies a placement to the calling thread and logs what the OS refused
+static auto placeThread(const ThreadPlacement &placement, const char *role) -> void
+{
+    auto result = applyThreadPlacement(placement);
+    if (!result.pinned)
+    {
+        logError(role, "thread: could not pin to cores", formatCoreList(placement.cores));
+    }
+    if (result.scheduling != placement.scheduling)
+    {
+        logError(role, "thread: scheduling", schedulingName(placement.scheduling), "not permitted, using", schedulingName(result.scheduling));
+    }
+    logInfo(role, "thread: cores", formatCoreList(placement.cores), "scheduling", schedulingName(result.scheduling));
+}
+
+struct CapturedFrame
+{
+    cv::Mat image;   ///< BGR capture of the grab rectangle
+    uint64_t ts = 0; ///< Time the grab started
+};
+
+struct PreparedFrame
+{
+    cv::Mat gray;    ///< Grayscale frame at match scale
+    uint64_t ts = 0; ///< Capture time, used as the tracker timestamp
+    int xFactor = 1; ///< Extra horizontal reduction of gray, see Detector::horizontalFactor
+};
+
+struct KeyAction
+{
+    WORD key = 0;
+    uint64_t ts = 0; ///< Capture time of the frame that triggered the key
+};
+
+/**
+ * @brief Capture, preprocess and act stages of the detection loop, each on its own thread.
+ *
+ * Matching and tracking run on the caller's thread between next() and press(). Frames move
+ * through LatestSlot mailboxes with latest-frame-wins: a new frame overwrites one the next
+ * stage has not taken yet, so a stage that falls behind always gets the newest frame and
+ * tracker timestamps stay close to the screen. Key presses go through an SpscRing, in
+ * order and never skipped. The stages end when the owner is
+ * destroyed or the active flag is cleared. Captures start on a FramePacer deadline, or in
+ * PACING_FRAME_ARRIVAL mode as soon as the capture source has a new frame.
+ */
+class FramePipeline
+{
+public:
+    FramePipeline(int captureMethod, RECT rect, double matchScale, double periodMs, int pacingMode,
+                  const ThreadPlacement &placement, const std::atomic<bool> &active)
+        : captureMethod{captureMethod}, rect{rect}, matchScale{matchScale}, pacingMode{pacingMode}, active{active}, pacer{periodMs}
+    {
+        // the stages share the cores and scheduling class of the detection thread
+        captureThread = std::jthread([this, placement](std::stop_token stopToken)
+                                     { placeThread(placement, "Capture"); capture(stopToken); });
+        preprocessThread = std::jthread([this, placement](std::stop_token stopToken)
+                                        { placeThread(placement, "Preprocess"); preprocess(stopToken); });
+        actThread = std::jthread([this, placement](std::stop_token stopToken)
+                                 { placeThread(placement, "Input"); act(stopToken); });
+    }
+
+    ~FramePipeline()
+    {
+        for (auto *thread : {&captureThread, &preprocessThread, &actThread})
+        {
+            thread->request_stop();
+        }
+        captured.close();
+        prepared.close();
+        actions.close();
+    }
+
+    /**
+     * @brief Match stage: blocks for the newest prepared frame, nullopt once the stages ended.
+     */
+    auto next(std::stop_token stopToken) -> std::optional<PreparedFrame>
+    {
+        if (!prepared.wait(stopToken))
+        {
+            return std::nullopt;
+        }
+        return prepared.popLatest();
+    }
+
+    /**
+     * @brief Match stage: sets the extra horizontal reduction of the frames prepared from now on.
+     */
+    auto setXFactor(int factor) -> void
+    {
+        xFactor = factor;
+    }
+
+    /**
+     * @brief Match stage: queues a key press for the act stage.
+     */
+    auto press(WORD key, uint64_t ts) -> void
+    {
+        if (!actions.push({key, ts}))
+        {
+            logError("Key queue full. Skip the keypress");
+        }
+    }
+
+    auto logStats() const -> void
+    {
+        // mailboxes overwrite frames the next stage has not taken; the key queue refuses when full
+        auto logSlot = [](const char *stage, const RingStats &s)
+        {
+            logInfo(stage, "pushed", s.pushed, "overwritten", s.skipped);
+        };
+        logSlot("Capture ->", captured.stats());
+        logSlot("Preprocess ->", prepared.stats());
+        const auto a = actions.stats();
+        logInfo("Match -> pushed", a.pushed, "dropped", a.dropped, "occupancy", a.occupancy, "/", a.capacity);
+        const uint64_t n = presses.load();
+        if (n > 0)
+        {
+            logInfo("Capture to keypress", double(latencySum.load()) / n, "ms over", n, "presses");
+        }
+        const auto p = pacer.stats();
+        logInfo("Pacing", pacingMode == PACING_FRAME_ARRIVAL ? "frame arrival" : "period", pacer.periodMs(), "ms: frames", p.frames,
+                "overruns", p.overruns, "timeouts", p.timeouts, "lateness mean", p.meanLatenessMs, "max", p.maxLatenessMs,
+                "ms, interval mean", p.meanIntervalMs, "max", p.maxIntervalMs, "ms");
+    }
+
+private:
+    auto capture(std::stop_token stopToken) -> void
+    {
+        // created on this thread, as desktop duplication is bound to the thread that opened it
+        std::unique_ptr<ScreenCapture> screenCapture;
+        if (captureMethod == 1)
+        {
+            screenCapture = std::make_unique<WinApiScreenCapture>();
+        }
+        else
+        {
+            screenCapture = std::make_unique<DesktopDuplicationCapture>();
+        }
+        // the grab itself waits for the next frame; a timeout is a static screen, not an error
+        bool arrival = false;
+        if (pacingMode == PACING_FRAME_ARRIVAL)
+        {
+            arrival = screenCapture->setFrameWait(FRAME_WAIT_TIMEOUT);
+            if (!arrival)
+            {
+                logError("Capture method", captureMethod, "cannot signal new frames, pacing by the frame period");
+            }
+        }
+        pacer.restart();
+        while (active && !stopToken.stop_requested())
+        {
+            auto start = CurrentMilliseconds();
+            auto screenOpt = screenCapture->grabScreen(rect);
+            if (!screenOpt.has_value())
+            {
+                if (!arrival || CurrentMilliseconds() - start < FRAME_WAIT_TIMEOUT)
+                {
+                    logError("Failed to grab screen");
+                    Sleep(5);
+                }
+                else
+                {
+                    pacer.timedOut();
+                }
+                continue;
+            }
+            if (screenOpt->cols != rect.right - rect.left || screenOpt->rows != rect.bottom - rect.top)
+            {
+                logError("Captured region is incorrect. Skip the frame");
+                Sleep(5);
+                continue;
+            }
+            // overwrites a frame the preprocess stage has not taken yet
+            captured.push({std::move(*screenOpt), start});
+            if (arrival)
+            {
+                pacer.arrived();
+            }
+            else
+            {
+                pacer.wait();
+            }
+        }
+        captured.close();
+    }
+
+    auto preprocess(std::stop_token stopToken) -> void
+    {
+        while (captured.wait(stopToken))
+        {
+            auto frame = captured.popLatest();
+            PreparedFrame out{{}, frame->ts, xFactor};
+            cv::cvtColor(frame->image, out.gray, cv::COLOR_BGR2GRAY);
+            if (out.xFactor > 1)
+            {
+                // anisotropic matching: the x reduction is folded into the one resize
+                cv::resize(out.gray, out.gray, cv::Size(), matchScale / out.xFactor, matchScale, cv::INTER_AREA);
+            }
+            else if (matchScale != 1.0)
+            {
+                cv::resize(out.gray, out.gray, cv::Size(), matchScale, matchScale, cv::INTER_NEAREST);
+            }
+            prepared.push(std::move(out));
+        }
+        prepared.close();
+    }
+
+    auto act(std::stop_token stopToken) -> void
+    {
+        while (actions.wait(stopToken) && !stopToken.stop_requested())
+        {
+            auto action = actions.pop();
+            SimulateKeyPress(action->key);
+            latencySum += CurrentMilliseconds() - action->ts;
+            ++presses;
+        }
+    }
+
+    const int captureMethod;
+    const RECT rect;
+    const double matchScale;
+    const int pacingMode;
+    const std::atomic<bool> &active;
+    FramePacer pacer; ///< Used by the capture stage only; its stats are read by the match stage
+    LatestSlot<CapturedFrame> captured;
+    LatestSlot<PreparedFrame> prepared;
+    std::atomic<int> xFactor{1};
+    SpscRing<KeyAction, 64> actions;
+    std::atomic<uint64_t> latencySum{0};
+    std::atomic<uint64_t> presses{0};
+    // last members: the stages are joined before the rings they use are destroyed
+    std::jthread captureThread;
+    std::jthread preprocessThread;
+    std::jthread actThread;
+};
+
 
 auto DetectLoop::loop(std::stop_token stopToken) -> void
 {
 
     std::unique_ptr<ScreenCapture> screenCapture;
     logInfo("opencv", cv::getBuildInformation()); 
-    auto numThreads = cv::getNumThreads();
-    auto setThreads = (numThreads + 1) / 2;
-    logInfo("Threads:", numThreads, "SetThreads:", setThreads);
-
-    cv::setNumThreads(setThreads);
-    auto matchScale = 1.0;
-    cv::Mat leftTemplate, rightTemplate, upTemplate, downTemplate;
-    cv::cvtColor(trackObject, upTemplate, cv::COLOR_BGR2GRAY);
-    cv::rotate(upTemplate, leftTemplate, cv::ROTATE_90_COUNTERCLOCKWISE);
-    cv::rotate(upTemplate, rightTemplate, cv::ROTATE_90_CLOCKWISE);
-    cv::rotate(leftTemplate, downTemplate, cv::ROTATE_90_COUNTERCLOCKWISE);
+    // native resolution: templates are scaled once per capture size instead of resizing every frame
+    MatchGeometry geometry;
+    int geometryWidth = 0;
+    logInfo("NCC peak kernel:", simdLevelName(detectSimdLevel()));
+    // the lane layout is fixed while the thread runs; every batch of lanes gets its own detector
+    const auto batches = laneLayout.batches();
+    const int laneCount = laneLayout.size();
+    std::vector<int> laneBatch(laneCount);
+    for (size_t b = 0; b < batches.size(); b++)
+    {
+        for (int lane : batches[b])
+        {
+            if (lane >= 0)
+            {
+                laneBatch[lane] = int(b);
+            }
+        }
+    }
+    // one pool for everything: the task graph below and, through the backend, every OpenCV
+    // parallel region of the pipeline stages and the detectors
+    std::shared_ptr<WorkerPool> pool;
+    std::unique_ptr<TaskGraph> graph;
+    uint64_t poolCores = 0;
+    // (re)creates the pool on the cores the detection threads leave over
+    auto ensurePool = [&](uint64_t detectionCores)
+    {
+        const uint64_t cores = workerCores(detectionCores);
+        if (pool && cores == poolCores)
+        {
+            return;
+        }
+        graph = nullptr;
+        setPoolParallelBackend(nullptr);
+        pool = nullptr;
+        const int threads = cores ? std::popcount(cores) : cv::getNumberOfCPUs();
+        pool = std::make_shared<WorkerPool>(threads, [cores]
+                                            { placeThread({cores, SCHEDULING_NORMAL}, "Worker"); });
+        setPoolParallelBackend(pool);
+        graph = std::make_unique<TaskGraph>(*pool);
+        poolCores = cores;
+        logInfo("Threads:", pool->threads(), "on cores", formatCoreList(cores), "OpenCV backend:", cv::getNumThreads());
+    };
+    std::vector<std::unique_ptr<Detector>> detectors;
+    int activeDetector = -1;
+    double preparedScale = 0;
+    DetectorOptions options;
+    // (re)creates the selected detector; checked every frame so engines swap without a restart
+    auto ensureDetector = [&]
+    {
+        int wanted = detectorIndex;
+        if (!detectors.empty() && wanted == activeDetector && preparedScale == geometry.scale)
+        {
+            return;
+        }
+        auto &registry = DetectorRegistry::instance();
+        if (wanted < 0 || wanted >= int(registry.names().size()))
+        {
+            logError("Unknown detector index", wanted, "- using the default detector");
+            wanted = 0;
+        }
+        std::vector<cv::Mat> variants{trackObject};
+        variants.insert(variants.end(), templateVariants.begin(), templateVariants.end());
+        if (geometry.scale != 1.0)
+        {
+            for (auto &v : variants)
+            {
+                cv::resize(v, v, cv::Size(), geometry.scale, geometry.scale, geometry.scale < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+            }
+        }
+        std::vector<std::unique_ptr<Detector>> created;
+        for (size_t b = 0; b < batches.size(); b++)
+        {
+            created.push_back(registry.create(wanted));
+            created.back()->prepareVariants(variants);
+            created.back()->configure(options);
+        }
+        detectors = std::move(created);
+        preparedScale = geometry.scale;
+        activeDetector = wanted;
+        logInfo("Detector:", detectors.front()->name(), "lanes:", laneCount, "batches:", detectors.size(), "x factor:", detectors.front()->horizontalFactor());
+    };
 
     while (!stopToken.stop_requested())
     {
@@ -148,120 +441,271 @@ auto DetectLoop::loop(std::stop_token stopToken) -> void
         int comboMax = comboLimit;
         int fps = 0;
         auto totalElapsed = 0.0;
-        NaiveTracker l_tracker{"left: "}, d_tracker{"down: "}, u_tracker{"up:    "}, r_tracker("right:");
+        uint64_t statsTs = 0;
+        options = {pyramidFactor, anisotropicFactor};
+        bool native = nativeResolution;
+        const ThreadPlacement placement{threadCores, threadScheduling};
+        placeThread(placement, "Detection");
+        ensurePool(placement.cores);
+        // the border search runs at the capture period too, then the pipeline's pacer takes over
+        const double periodMs = framePeriod > 0 ? framePeriod.load() : FRAME_PERIOD;
+        FramePacer borderPacer(periodMs);
+        geometry = {};
+        geometryWidth = 0;
+        ensureDetector();
+        for (auto &detector : detectors)
+        {
+            detector->configure(options);
+        }
+        if (options.anisotropicFactor > 1 && detectors.front()->horizontalFactor() == 1)
+        {
+            logInfo("Detector", detectors.front()->name(), "does not support AnisotropicFactor, matching uniformly");
+        }
+        int mode = windowMode;
+        int framesSinceFullMatch = FULL_MATCH_PERIOD;
+        ScrollEstimator scroll;
+        long long lastScrollTs = 0;
+        std::vector<NaiveTracker> trackers;
+        // band and x factor the column locks were made for
+        std::vector<ColumnLock> columnLocks(laneCount);
+        std::pair<int, int> columnBand{ColumnLock::BAND, 1};
+        for (int i = 0; i < laneCount; i++)
+        {
+            trackers.emplace_back(laneLayout[i].name);
+            trackers.back().setSpawnScore(NO_OCCULSION_THRESHOLD);
+        }
+        std::unique_ptr<FramePipeline> pipeline;
         while (m_loop && !stopToken.stop_requested())
         {
-            auto start = CurrentMilliseconds();
-            if (!screenCapture)
+            if (pipeline)
             {
-                logInfo("DetectLoop loop inner loop Screen Capture init", captureMethod);
-                // Create the screen capture object based on the capture method
-                if (captureMethod == 1)
+                // match stage: the newest preprocessed frame, older ones are skipped
+                auto frame = pipeline->next(stopToken);
+                if (!frame)
                 {
-                    screenCapture = std::make_unique<WinApiScreenCapture>();
+                    // paused or stopped: the stages have ended
+                    break;
                 }
-                else
+                const auto start = frame->ts;
+                cv::Mat grayScreen = std::move(frame->gray);
+                auto tt = CurrentMilliseconds();
+                if (native)
                 {
-                    screenCapture = std::make_unique<DesktopDuplicationCapture>();
+                    // native frames arrive at capture size, apart from an anisotropic x reduction
+                    const int rW = grayScreen.cols * frame->xFactor;
+                    if (rW != geometryWidth)
+                    {
+                        // new capture size: rescale templates and geometry once, not the frames
+                        geometryWidth = rW;
+                        geometry.scale = rW / REFERENCE_WIDTH;
+                        scroll = ScrollEstimator{geometry.scaled(ScrollEstimator::MAX_SHIFT)};
+                        for (auto &tracker : trackers)
+                        {
+                            tracker.setIgnoreDisp(geometry.scaled(IGNORE_DISP));
+                        }
+                        logInfo("Native resolution: width", rW, "geometry scale", geometry.scale);
+                    }
                 }
-            }
-
-            auto screenOpt = screenCapture->grabScreen(rect);
-            if(!screenOpt.has_value()){
-                
-                logError("Failed to grab screen");
-                Sleep(5);
-                continue;
-            }
-            cv::Mat grayScreen;
-            cv::cvtColor(screenOpt.value(), grayScreen, cv::COLOR_BGR2GRAY);
-            std::optional<RECT> potentialBorder = std::nullopt;
-            Sleep(1);
-            if (borderDetectionCount <= BORDER_MATCH_COUNT)
-            {
-                // Downsample the image
-                cv::resize(grayScreen, grayScreen, cv::Size(), 0.5, 0.5);
-                potentialBorder = detectBorder(grayScreen, MINIMUM_LINE_LENGTH);
-                potentialBorder = doubleRectCoords(potentialBorder);
-            }
-            else
-            {
-                //check if captured region is correct;
-                auto rW=rect.right-rect.left;
-                auto rH=rect.bottom-rect.top;
-                if(rW!=grayScreen.cols || rH != grayScreen.rows){
-                    logError("Captured region is incorrect. Skip the frame");
-                    Sleep(5);
+                auto exitAreaY = grayScreen.rows - geometry.scaled(DETECT_AREA_HEIGHT);
+                logInfo("Detection: exitAreaY:", exitAreaY);
+                auto regions = laneLayout.regions(grayScreen.size());
+                std::vector<int> laneExit(laneCount);
+                for (int i = 0; i < laneCount; i++)
+                {
+                    // rotated templates sit differently on the exit line
+                    laneExit[i] = exitAreaY - geometry.scaled(laneLayout[i].exitAdjust);
+                    trackers[i].setExitAreaY(exitAreaY);
+                }
+                ensureDetector();
+                const int xFactor = detectors.front()->horizontalFactor();
+                pipeline->setXFactor(xFactor);
+                if (frame->xFactor != xFactor)
+                {
+                    // reduced for the previous detector; the next frames have the new factor
                     continue;
                 }
-                matchScale = 373.0 / rW;
-                logInfo("matchScale", matchScale);
-                auto tt = CurrentMilliseconds();
-                cv::resize(grayScreen, grayScreen, cv::Size(), matchScale, matchScale, cv::INTER_NEAREST);
-                auto exitAreaY = grayScreen.rows - DETECT_AREA_HEIGHT;
-                auto leftExitAreaY = exitAreaY - 6; //adjust for left lane
-                auto rightExitAreaY = exitAreaY - 9; //adjust for right lane
-                logInfo("Detection: exitAreaY:", exitAreaY, "leftExitAreaY:", leftExitAreaY, "rightExitAreaY:", rightExitAreaY);
-                l_tracker.setExitAreaY(exitAreaY);
-                d_tracker.setExitAreaY(exitAreaY);
-                u_tracker.setExitAreaY(exitAreaY);
-                r_tracker.setExitAreaY(exitAreaY);
-                double whx = grayScreen.cols / 4.0;
-                int wh0 = int(whx);
-                int wh1 = int(whx * 2);
-                int wh2 = int(whx * 3);
-                cv::Rect matchRegion{0, 0, wh0, grayScreen.rows};
-                auto lMatches = getLocationsBottomY( matchTemplateInRegion(grayScreen, leftTemplate, matchRegion), leftTemplate.rows, leftExitAreaY);
-                matchRegion.x = wh0;
-                auto dMatches = getLocationsBottomY( matchTemplateInRegion(grayScreen, downTemplate, matchRegion), leftTemplate.rows, exitAreaY);
-                matchRegion.x = wh1;
-                auto uMatches = getLocationsBottomY( matchTemplateInRegion(grayScreen, upTemplate, matchRegion), leftTemplate.rows, exitAreaY);
-                matchRegion.x = wh2;
-                auto rMatches = getLocationsBottomY( matchTemplateInRegion(grayScreen, rightTemplate, matchRegion), leftTemplate.rows, rightExitAreaY);
+                // column x is in reduced pixels with anisotropic matching
+                const std::pair<int, int> band{std::max(1, geometry.scaled(ColumnLock::BAND) / xFactor), xFactor};
+                if (band != columnBand)
+                {
+                    columnLocks.assign(laneCount, ColumnLock{band.first});
+                    columnBand = band;
+                }
+                const int templHeight = detectors.front()->templateSize(LANE_LEFT).height;
+                std::vector<std::vector<cv::Range>> predicted(laneCount), windows(laneCount);
+                // tracks moved by the global scroll, outside the matched bands
+                std::vector<std::vector<int>> propagated(laneCount);
+                bool windowed = false;
+                std::optional<float> shift;
+                if (mode == WINDOW_MODE_SCROLL)
+                {
+                    shift = scroll.estimate(grayScreen, regions);
+                    float speed = 0;
+                    if (shift && lastScrollTs != 0 && start > lastScrollTs)
+                    {
+                        speed = std::max(*shift, 0.0f) / float(start - lastScrollTs);
+                    }
+                    lastScrollTs = start;
+                    for (auto &tracker : trackers)
+                    {
+                        tracker.setScrollSpeed(speed);
+                    }
+                }
+                if (mode == WINDOW_MODE_SCROLL && shift && framesSinceFullMatch < FULL_MATCH_PERIOD)
+                {
+                    // match only where arrows appear and where they are about to pass
+                    const cv::Range entry{templHeight, templHeight + geometry.scaled(ENTRY_BAND_HEIGHT)};
+                    const cv::Range verify{exitAreaY - geometry.scaled(VERIFY_BAND_HEIGHT), exitAreaY + templHeight + 1};
+                    const int margin = geometry.scaled(WINDOW_MARGIN);
+                    for (int i = 0; i < laneCount; i++)
+                    {
+                        for (int y : trackers[i].propagate(int(std::lround(*shift))))
+                        {
+                            if (y >= verify.start && y < verify.end)
+                            {
+                                predicted[i].emplace_back(y - margin, y + margin + 1);
+                            }
+                            else if (y < verify.start && (y < entry.start || y >= entry.end))
+                            {
+                                // tracks past the exit are dropped like unmatched ones
+                                propagated[i].push_back(y);
+                            }
+                        }
+                        windows[i] = {entry, verify};
+                    }
+                    windowed = true;
+                    ++framesSinceFullMatch;
+                }
+                else if (mode == WINDOW_MODE_PREDICTED && framesSinceFullMatch < FULL_MATCH_PERIOD)
+                {
+                    // correlate only around tracked arrows and in the entry band at the top
+                    for (int i = 0; i < laneCount; i++)
+                    {
+                        predicted[i] = trackers[i].predictWindows(start, geometry.scaled(WINDOW_MARGIN));
+                        windows[i] = predicted[i];
+                        windows[i].emplace_back(templHeight, templHeight + geometry.scaled(ENTRY_BAND_HEIGHT));
+                    }
+                    windowed = true;
+                    ++framesSinceFullMatch;
+                }
+                else
+                {
+                    framesSinceFullMatch = 0;
+                }
+                // one request per batch: slot r holds the batch lane matched with rotation r
+                std::vector<DetectionRequest> requests(batches.size());
+                std::vector<std::array<std::vector<cv::Range>, LANE_COUNT>> batchWindows(batches.size());
+                for (size_t b = 0; b < batches.size(); b++)
+                {
+                    auto &request = requests[b];
+                    request.threshold = DETECTION_THRESHOLD;
+                    request.dispY = geometry.scaled(LOCATION_DISP_Y);
+                    request.agreeDisp = geometry.scaled(ProjectionDetector::AGREE_DISP);
+                    for (int r = 0; r < LANE_COUNT; r++)
+                    {
+                        const int lane = batches[b][r];
+                        if (lane < 0)
+                        {
+                            // unused slot: empty regions match nothing
+                            request.exitArea[r] = -1;
+                            continue;
+                        }
+                        request.lanes[r] = regions[lane];
+                        // search only a narrow band around each lane's learned arrow column
+                        request.search[r] = columnLocks[lane].restrict(regions[lane], detectors[b]->templateSize(r).width);
+                        request.exitArea[r] = laneExit[lane];
+                        batchWindows[b][r] = windows[lane];
+                    }
+                    request.windows = windowed ? &batchWindows[b] : nullptr;
+                }
+                std::vector<std::vector<Detection>> matches(laneCount);
+                std::vector<char> passed(laneCount), missed(laneCount);
+                // per frame: each batch's detector, then each lane's tracker as soon as its batch is done;
+                // key presses stay in lane order after the graph
+                graph->clear();
+                std::vector<int> detectNodes(batches.size());
+                for (size_t b = 0; b < batches.size(); b++)
+                {
+                    detectNodes[b] = graph->add("detect " + std::to_string(b), [&, b]
+                                                {
+                        auto detections = detectors[b]->detect(grayScreen, requests[b]);
+                        // a batch runs its lanes in parallel: report each lane so the slow one shows up
+                        const auto laneMs = detectors[b]->laneTimesMs();
+                        for (int r = 0; r < LANE_COUNT; r++)
+                        {
+                            if (batches[b][r] >= 0)
+                            {
+                                matches[batches[b][r]] = std::move(detections[r]);
+                                if (laneMs)
+                                {
+                                    graph->addSpan(detectNodes[b], "match " + laneLayout[batches[b][r]].name, (*laneMs)[r]);
+                                }
+                            }
+                        } });
+                }
+                for (int i = 0; i < laneCount; i++)
+                {
+                    graph->add("track " + laneLayout[i].name, [&, i]
+                              {
+                        columnLocks[i].observe(matches[i], NO_OCCULSION_THRESHOLD);
+                        // a tracked arrow missing from its predicted window forces a full match next frame
+                        for (const auto &w : predicted[i])
+                        {
+                            bool found = w.start >= exitAreaY || std::any_of(matches[i].begin(), matches[i].end(), [&](const Detection &d)
+                                                                             { return d.y >= w.start && d.y < w.end; });
+                            missed[i] |= !found;
+                        }
+                        // propagated tracks stand in for detections where nothing was matched
+                        auto tracked = matches[i];
+                        for (int y : propagated[i])
+                        {
+                            tracked.push_back({y, -1, 0.0f});
+                        }
+                        if (!propagated[i].empty())
+                        {
+                            std::sort(tracked.begin(), tracked.end(), [](const Detection &a, const Detection &b)
+                                      { return a.y < b.y; });
+                        }
+                        passed[i] = trackers[i].updateTracker(tracked, start); }, {detectNodes[laneBatch[i]]});
+                }
+                graph->run();
                 auto cc = CurrentMilliseconds() - tt;
-                logInfo("matched in ", cc, "ms", " ss: ", dc);
+                logInfo("matched and tracked in ", cc, "ms", " ss: ", dc);
+                for (int i = 0; i < laneCount; i++)
+                {
+                    if (missed[i])
+                    {
+                        logInfo("Prediction missed in lane", i, "full match next frame");
+                        framesSinceFullMatch = FULL_MATCH_PERIOD;
+                    }
+                }
                 if (saveForDebug)
                 {
-                    logInfo(
-                        "Matched sizes - Left: ", lMatches.size(),
-                        ", Down: ", dMatches.size(),
-                        ", Up: ", uMatches.size(),
-                        ", Right: ", rMatches.size());
-
-                    auto drawLine = [&](const std::vector<int> &matches, int offsetX)
+                    for (int i = 0; i < laneCount; i++)
                     {
-                        for (const auto &match : matches)
-                        { 
-                            cv::line(grayScreen, cv::Point(offsetX,match), cv::Point(offsetX+wh0,match),cv::Scalar(255, 255, 255), 2);
+                        logInfo("Matched size", laneLayout[i].name, matches[i].size());
+                        // Draw line in the bottom for each match
+                        for (const auto &match : matches[i])
+                        {
+                            cv::line(grayScreen, cv::Point(regions[i].x, match.y), cv::Point(regions[i].x + regions[i].width, match.y), cv::Scalar(255, 255, 255), 2);
                         }
-                    };
-
-                    // Draw line in the bottom for each match set
-                    drawLine(lMatches, 0);
-                    drawLine(dMatches, wh0);
-                    drawLine(uMatches, wh1);
-                    drawLine(rMatches, wh2);
+                    }
 
                     // Ensure `dc` is within valid range and save the updated gray screen
                     dc = dc % DCMAX;
                     cv::imwrite(std::to_string(dc) + ".jpg", grayScreen);
                     dc++;
 
-                    NaiveTracker::printDetections("Left Detections", lMatches);
-                    NaiveTracker::printDetections("Down Detections", dMatches);
-                    NaiveTracker::printDetections("Up Detections", uMatches);
-                    NaiveTracker::printDetections("Right Detections", rMatches);
+                    for (int i = 0; i < laneCount; i++)
+                    {
+                        NaiveTracker::printDetections(laneLayout[i].name + " Detections", matches[i]);
+                    }
                 }
-
-                NaiveTracker* trackers[] = {&l_tracker, &d_tracker, &u_tracker, &r_tracker};
-                std::vector<int> matches[] = {lMatches, dMatches, uMatches, rMatches};
-                int keys[] = {VK_LEFT, VK_DOWN, VK_UP, VK_RIGHT};
-
-                for (size_t i = 0; i < 4; ++i) {
-                    if (trackers[i]->updateTracker(matches[i], start)) {
+                for (int i = 0; i < laneCount; ++i) {
+                    if (passed[i]) {
                         if(combosCount < comboMax){
                             ++combosCount;
-                            SimulateKeyPress(keys[i]);
+                            pipeline->press(WORD(laneLayout[i].key), start);
                         }else{
                             logInfo("Combo limit reached. Skip the keypress");
                             combosCount = 0;
@@ -269,12 +713,54 @@ auto DetectLoop::loop(std::stop_token stopToken) -> void
                     }
                 }
                 if(saveForDebug){
-                    l_tracker.printLane();
-                    d_tracker.printLane();
-                    u_tracker.printLane();
-                    r_tracker.printLane();
+                    for (const auto &tracker : trackers)
+                    {
+                        tracker.printLane();
+                    }
                 } 
+                ++fps;
+                const auto statsElapsed = CurrentMilliseconds() - statsTs;
+                if (statsElapsed >= STATS_PERIOD)
+                {
+                    logInfo("FPS", fps * 1000.0 / statsElapsed);
+                    pipeline->logStats();
+                    graph->logTimings();
+                    graph->resetTimings();
+                    statsTs = CurrentMilliseconds();
+                    fps = 0;
+                }
+                continue;
+            }
+            auto start = CurrentMilliseconds();
+            if (!screenCapture)
+            {
+                logInfo("DetectLoop loop inner loop Screen Capture init", captureMethod);
+                // Create the screen capture object based on the capture method
+                if (captureMethod == 1)
+                {
+                    screenCapture = std::make_unique<WinApiScreenCapture>();
+                }
+                else
+                {
+                    screenCapture = std::make_unique<DesktopDuplicationCapture>();
+                }
+            }
+
+            auto screenOpt = screenCapture->grabScreen(rect);
+            if(!screenOpt.has_value()){
+                
+                logError("Failed to grab screen");
+                Sleep(5);
+                continue;
             }
+            cv::Mat grayScreen;
+            cv::cvtColor(screenOpt.value(), grayScreen, cv::COLOR_BGR2GRAY);
+            std::optional<RECT> potentialBorder = std::nullopt;
+            // the border is searched serially; once it is fixed the pipeline takes over
+            // Downsample the image
+            cv::resize(grayScreen, grayScreen, cv::Size(), 0.5, 0.5);
+            potentialBorder = detectBorder(grayScreen, MINIMUM_LINE_LENGTH);
+            potentialBorder = doubleRectCoords(potentialBorder);
             // Update the border if a potential border is found
             if (potentialBorder)
             {
@@ -303,6 +789,15 @@ auto DetectLoop::loop(std::stop_token stopToken) -> void
                         }
                         cv::imwrite("screen.jpg", screenOpt.value()); 
                     }
+                    // the stages own their capture object
+                    screenCapture = nullptr;
+                    const double matchScale = native ? 1.0 : REFERENCE_WIDTH / (rect.right - rect.left);
+                    logInfo("matchScale", matchScale);
+                    pipeline = std::make_unique<FramePipeline>(captureMethod, rect, matchScale, periodMs, pacingMode, placement, m_loop);
+                    pipeline->setXFactor(detectors.front()->horizontalFactor());
+                    statsTs = CurrentMilliseconds();
+                    fps = 0;
+                    continue;
                 }
             }
 
@@ -314,11 +809,13 @@ auto DetectLoop::loop(std::stop_token stopToken) -> void
                 totalElapsed = 0;
                 fps = 0;
             }
-            // Adjust CPU usage
-            Sleep(static_cast<DWORD>((elapsed < 45) ? (45 - elapsed) : 10));
+            borderPacer.wait();
             fps++;
         }
 
+        // stop the stages before the next session
+        pipeline.reset();
         Sleep(1000);
     }
+    setPoolParallelBackend(nullptr);
 }
@@ -3,9 +3,22 @@
 #include "cv_utils.h"
 #include <atomic>
 #include "ConfigDialog.h"
+#include "FramePacer.h"
+#include "LaneLayout.h"
+#include "ThreadPlacement.h"
 #include <semaphore>
 #include <thread>
 
+/**
+ * @brief How much of each lane is matched between two full matches.
+ */
+enum WindowMode
+{
+    WINDOW_MODE_FULL = 0,  ///< Full lanes every frame
+    WINDOW_MODE_PREDICTED, ///< Tracker-predicted windows and the entry band
+    WINDOW_MODE_SCROLL     ///< Tracks moved by the global scroll; only the entry and exit bands are matched
+};
+
 /**
  * @brief DetectLoop class
  * This class will track an object in the ava dance and simulate player input.
@@ -20,9 +33,22 @@ private:
     std::atomic<int> bottom; ///< Bottom boundary for tracking
     std::atomic<int> comboLimit; ///< Combo limit for tracking
     std::atomic<int> captureMethod; ///< Capture method for tracking
+    std::atomic<int> pyramidFactor = 0; ///< Coarse-to-fine matching factor, 0 for full resolution only
+    std::atomic<int> windowMode = WINDOW_MODE_FULL; ///< WindowMode used between full matches
+    std::atomic<int> anisotropicFactor = 0; ///< Horizontal lane downsampling factor, 0 for uniform matching
+    std::atomic<int> detectorIndex = 0; ///< Index of the selected detector in DetectorRegistry
+    std::atomic<bool> nativeResolution = false; ///< Match at capture resolution with scaled templates and geometry
+    std::atomic<uint64_t> threadCores = 0; ///< Cores of the detection, capture and input threads, 0 for all
+    std::atomic<int> threadScheduling = SCHEDULING_NORMAL; ///< SchedulingClass of the same threads
+    std::optional<uint64_t> coresOverride; ///< Command line cores, replace the config ones
+    std::optional<int> schedulingOverride; ///< Command line scheduling class, replaces the config one
+    std::atomic<int> framePeriod = 0; ///< Target capture period in ms, 0 for the default
+    std::atomic<int> pacingMode = PACING_PERIOD; ///< PacingMode of the capture stage
     std::atomic<bool> saveImagesAndTracks = false; ///< Flag to save images and tracks
     std::binary_semaphore sem{0}; ///< Semaphore for synchronization
     cv::Mat trackObject; ///< Object to be tracked
+    std::vector<cv::Mat> templateVariants; ///< Extra variants of the tracked object for the template bank
+    LaneLayout laneLayout = LaneLayout::standard(); ///< Lanes matched and tracked, with their keys
     uint64_t id = CurrentMilliseconds(); ///< Unique ID for the instance
     std::jthread detectThread; ///< Thread for detection loop
 
@@ -54,6 +80,75 @@ public:
         return false;
     }
 
+    /**
+     * @brief Set extra variants of the tracked object, e.g. arrows of other skins
+     *
+     * @param variants The variants, matched besides the tracked object by detectors with a template bank
+     * @return false if the detection thread is already running
+     */
+    auto setTemplateVariants(const std::vector<cv::Mat> &variants) -> bool
+    {
+        if (!detectThread.joinable())
+        {
+            templateVariants = variants;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Set the lane layout
+     *
+     * @param layout Lanes with their x-extent, template rotation and key binding
+     * @return false if the detection thread is already running
+     */
+    auto setLaneLayout(const LaneLayout &layout) -> bool
+    {
+        if (!detectThread.joinable())
+        {
+            laneLayout = layout;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Set the thread placement, overriding the given fields of the config
+     *
+     * @param cores Cores of the detection, capture and input threads, nullopt keeps the config ones
+     * @param scheduling Scheduling class of the same threads, nullopt keeps the config one
+     * @return false if the detection thread is already running
+     */
+    auto setThreadPlacement(std::optional<uint64_t> cores, std::optional<int> scheduling) -> bool
+    {
+        if (!detectThread.joinable())
+        {
+            coresOverride = cores;
+            schedulingOverride = scheduling;
+            if (cores)
+            {
+                threadCores = *cores;
+            }
+            if (scheduling)
+            {
+                threadScheduling = *scheduling;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Select the detector by its DetectorRegistry index
+     * Takes effect with the next frame, also while the loop is running
+     *
+     * @param index Index of the detector
+     */
+    auto setDetector(int index) -> void
+    {
+        detectorIndex = index;
+    }
+
     /**
      * @brief Set the parameters for tracking
      * 
@@ -66,6 +161,14 @@ public:
         // Capture method and thresholds
         captureMethod = config.ScreenCaptureMethod();
         comboLimit    = config.ComboThreshold();
+        pyramidFactor = config.PyramidFactor();
+        windowMode = config.PredictWindows();
+        anisotropicFactor = config.AnisotropicFactor();
+        nativeResolution = config.NativeResolution() != 0;
+        threadCores = coresOverride.value_or(config.DetectCores());
+        threadScheduling = schedulingOverride.value_or(config.DetectScheduling());
+        framePeriod = config.FramePeriod();
+        pacingMode = config.PacingMode();
 
         // Apply offsets
         left   = screenRect.left   + config.Left();
@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * @brief A lane detection handed from the matcher to the tracker.
+ */
+struct Detection
+{
+    int y;       ///< Bottom Y of the match in the frame
+    int x;       ///< Column of the match in the lane region, -1 if the detector does not localize x
+    float score; ///< TM_CCOEFF_NORMED score
+    int variant = 0; ///< Index of the matched template variant, see TemplateBankDetector
+};
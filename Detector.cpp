@@ -0,0 +1,487 @@
+#include "Detector.h"
+
+#include <algorithm>
+#include <cmath>
+
+DetectorRegistry::DetectorRegistry()
+{
+    // MatchEngine order: index == engine value
+    constexpr std::pair<const char *, MatchEngine> builtins[] = {
+        {"auto", MATCH_ENGINE_AUTO},
+        {"ncc", MATCH_ENGINE_OPENCV},
+        {"spatial", MATCH_ENGINE_SPATIAL},
+        {"fft", MATCH_ENGINE_FFT},
+        {"sparse", MATCH_ENGINE_SPARSE},
+        {"binary", MATCH_ENGINE_BINARY},
+        {"blob", MATCH_ENGINE_BLOB},
+    };
+    for (auto [name, engine] : builtins)
+    {
+        add(name, [name, engine]
+            { return std::make_unique<LaneMatcherDetector>(name, engine); });
+    }
+    add("cascade", []
+        { return std::make_unique<CascadeDetector>(); });
+    add("projection", []
+        { return std::make_unique<ProjectionDetector>(); });
+    add("bank", []
+        { return std::make_unique<TemplateBankDetector>(); });
+}
+
+// maps peaks of the searched regions to sorted lane detections
+static auto toDetections(std::array<std::vector<MatchPeak>, LANE_COUNT> &peaks, const DetectionRequest &request, int templHeight) -> std::array<std::vector<Detection>, LANE_COUNT>
+{
+    std::array<std::vector<Detection>, LANE_COUNT> detections;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        // back to full lane coordinates
+        for (auto &p : peaks[i])
+        {
+            if (p.x >= 0)
+            {
+                p.x += request.search[i].x - request.lanes[i].x;
+            }
+        }
+        detections[i] = getLocationDetections(peaks[i], templHeight, request.exitArea[i], request.dispY);
+    }
+    return detections;
+}
+
+// counts |I(x+1) - I(x)| > threshold per row
+static auto rowGradientCounts(const cv::Mat &img, int threshold) -> cv::Mat
+{
+    cv::Mat diff, strong, counts;
+    cv::absdiff(img.colRange(1, img.cols), img.colRange(0, img.cols - 1), diff);
+    cv::threshold(diff, strong, threshold, 1, cv::THRESH_BINARY);
+    cv::reduce(strong, counts, 1, cv::REDUCE_SUM, CV_32S);
+    return counts;
+}
+
+auto DetectorRegistry::instance() -> DetectorRegistry &
+{
+    static DetectorRegistry registry;
+    return registry;
+}
+
+auto DetectorRegistry::add(const std::string &name, Factory factory) -> void
+{
+    int index = indexOf(name);
+    if (index >= 0)
+    {
+        factories[index].second = std::move(factory);
+        return;
+    }
+    factories.emplace_back(name, std::move(factory));
+}
+
+auto DetectorRegistry::create(int index) const -> std::unique_ptr<Detector>
+{
+    if (index < 0 || index >= int(factories.size()))
+    {
+        return nullptr;
+    }
+    return factories[index].second();
+}
+
+auto DetectorRegistry::indexOf(const std::string &name) const -> int
+{
+    for (int i = 0; i < int(factories.size()); i++)
+    {
+        if (factories[i].first == name)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+auto DetectorRegistry::names() const -> std::vector<std::string>
+{
+    std::vector<std::string> result;
+    for (const auto &f : factories)
+    {
+        result.push_back(f.first);
+    }
+    return result;
+}
+
+auto LaneMatcherDetector::prepare(const cv::Mat &upTemplate) -> void
+{
+    // rotations and template statistics are prepared once for the whole session
+    matcher = LaneMatcher{upTemplate};
+    if (engine == MATCH_ENGINE_AUTO)
+    {
+        // measure spatial vs FFT correlation on this machine before the first frame
+        matcher.calibrate();
+    }
+    matcher.setEngine(engine);
+}
+
+auto LaneMatcherDetector::configure(const DetectorOptions &options) -> void
+{
+    matcher.setPyramid(options.pyramidFactor);
+    matcher.setAnisotropic(options.anisotropicFactor);
+}
+
+auto LaneMatcherDetector::detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT>
+{
+    // all lanes report bottom Y with the left template height, as the tracker thresholds expect
+    const int templHeight = matcher.templates()[LANE_LEFT].gray.rows;
+    std::array<std::vector<MatchPeak>, LANE_COUNT> peaks;
+    if (request.windows)
+    {
+        std::array<std::vector<cv::Range>, LANE_COUNT> rows;
+        for (int i = 0; i < LANE_COUNT; i++)
+        {
+            for (const auto &w : (*request.windows)[i])
+            {
+                rows[i].emplace_back(w.start - templHeight, w.end - templHeight);
+            }
+        }
+        peaks = matcher.matchPeaksInWindows(gray, request.search, rows, request.threshold);
+    }
+    else
+    {
+        peaks = matcher.matchPeaks(gray, request.search, request.threshold, &request.lanes);
+    }
+    return toDetections(peaks, request, templHeight);
+}
+
+auto CascadeDetector::prepare(const cv::Mat &upTemplate) -> void
+{
+    matcher = LaneMatcher{upTemplate};
+    matcher.setEngine(MATCH_ENGINE_SPATIAL);
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        templEnergy[i] = int(cv::sum(rowGradientCounts(matcher.templates()[i].gray, GRADIENT_THRESHOLD))[0]);
+    }
+    counters = {};
+}
+
+auto CascadeDetector::proposeRows(const cv::Mat &gray, cv::Rect region, int lane) const -> std::vector<cv::Range>
+{
+    std::vector<cv::Range> rows;
+    const cv::Size tSize = matcher.templates()[lane].size();
+    region &= cv::Rect{0, 0, gray.cols, gray.rows};
+    if (region.width < std::max(tSize.width, 2) || region.height < tSize.height)
+    {
+        return rows;
+    }
+    cv::Mat counts = rowGradientCounts(gray(region), GRADIENT_THRESHOLD);
+    const int need = int(templEnergy[lane] * ENERGY_RATIO);
+    const int resH = region.height - tSize.height + 1;
+    // sliding sum of the row counts over the template height
+    int energy = 0;
+    for (int y = 0; y < tSize.height; y++)
+    {
+        energy += counts.at<int>(y, 0);
+    }
+    for (int y = 0; y < resH; y++)
+    {
+        if (y > 0)
+        {
+            energy += counts.at<int>(y + tSize.height - 1, 0) - counts.at<int>(y - 1, 0);
+        }
+        if (energy < need)
+        {
+            continue;
+        }
+        if (!rows.empty() && rows.back().end == y)
+        {
+            rows.back().end = y + 1;
+        }
+        else
+        {
+            rows.emplace_back(y, y + 1);
+        }
+    }
+    return rows;
+}
+
+auto CascadeDetector::detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT>
+{
+    const int templHeight = matcher.templates()[LANE_LEFT].gray.rows;
+    std::array<std::vector<cv::Range>, LANE_COUNT> candidates;
+    cv::TickMeter tm;
+    tm.start();
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        candidates[i] = proposeRows(gray, request.search[i], i);
+        if (request.windows)
+        {
+            // keep only candidates inside the requested windows (bottom Y to window rows)
+            std::vector<cv::Range> inside;
+            for (const auto &c : candidates[i])
+            {
+                for (const auto &w : (*request.windows)[i])
+                {
+                    cv::Range r{std::max(c.start, w.start - templHeight), std::min(c.end, w.end - templHeight)};
+                    if (r.start < r.end)
+                    {
+                        inside.push_back(r);
+                    }
+                }
+            }
+            candidates[i] = std::move(inside);
+        }
+        counters.rows += std::max(request.search[i].height - matcher.templates()[i].gray.rows + 1, 0);
+        for (const auto &c : candidates[i])
+        {
+            counters.proposed += c.size();
+        }
+    }
+    tm.stop();
+    counters.stage1Ms += tm.getTimeMilli();
+
+    tm.reset();
+    tm.start();
+    auto peaks = matcher.matchPeaksInWindows(gray, request.search, candidates, request.threshold);
+    tm.stop();
+    counters.stage2Ms += tm.getTimeMilli();
+    for (const auto &p : peaks)
+    {
+        counters.verified += p.size();
+    }
+    if (++counters.frames % STATS_PERIOD == 0)
+    {
+        logInfo("Cascade: rows", counters.rows, "proposed", counters.proposed, "rejection", counters.rejection(),
+                "verified peaks", counters.verified, "stage1", counters.stage1Ms / counters.frames, "ms/frame",
+                "stage2", counters.stage2Ms / counters.frames, "ms/frame");
+    }
+    return toDetections(peaks, request, templHeight);
+}
+
+auto ProjectionDetector::prepare(const cv::Mat &upTemplate) -> void
+{
+    matcher = LaneMatcher{upTemplate};
+    matcher.setEngine(MATCH_ENGINE_SPATIAL);
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        auto sums = rowSums(matcher.templates()[i].gray);
+        double mean = 0;
+        for (int s : sums)
+        {
+            mean += s;
+        }
+        mean /= std::max<size_t>(sums.size(), 1);
+        double norm = 0;
+        templProfile[i].resize(sums.size());
+        for (size_t y = 0; y < sums.size(); y++)
+        {
+            templProfile[i][y] = float(sums[y] - mean);
+            norm += double(templProfile[i][y]) * templProfile[i][y];
+        }
+        norm = norm > 0 ? 1.0 / std::sqrt(norm) : 0.0;
+        for (auto &v : templProfile[i])
+        {
+            v = float(v * norm);
+        }
+    }
+    frames = checked = agreed = 0;
+}
+
+auto ProjectionDetector::matchProfile(const cv::Mat &gray, cv::Rect region, int lane, float threshold) const -> std::vector<MatchPeak>
+{
+    std::vector<MatchPeak> peaks;
+    const auto &t = templProfile[lane];
+    const int h = int(t.size());
+    region &= cv::Rect{0, 0, gray.cols, gray.rows};
+    if (h == 0 || region.width < templateSize(lane).width || region.height < h)
+    {
+        return peaks;
+    }
+    const auto profile = rowSums(gray(region));
+    const int resH = region.height - h + 1;
+    // prefix sums give the window mean and variance in O(1); t is zero-mean so the dot needs no centring
+    std::vector<double> sum(profile.size() + 1, 0.0), sqSum(profile.size() + 1, 0.0);
+    for (size_t y = 0; y < profile.size(); y++)
+    {
+        sum[y + 1] = sum[y] + profile[y];
+        sqSum[y + 1] = sqSum[y] + double(profile[y]) * profile[y];
+    }
+    std::vector<float> scores(resH, 0.0f);
+    for (int y = 0; y < resH; y++)
+    {
+        const double s = sum[y + h] - sum[y];
+        const double var = (sqSum[y + h] - sqSum[y]) - s * s / h;
+        if (var <= 1e-6)
+        {
+            continue;
+        }
+        double dot = 0;
+        for (int k = 0; k < h; k++)
+        {
+            dot += t[k] * double(profile[y + k]);
+        }
+        scores[y] = float(dot / std::sqrt(var));
+    }
+    for (int y = 0; y < resH; y++)
+    {
+        // local maxima only; getLocationDetections suppresses the rest
+        if (scores[y] >= threshold && (y == 0 || scores[y] >= scores[y - 1]) && (y + 1 == resH || scores[y] > scores[y + 1]))
+        {
+            peaks.push_back({y, -1, scores[y]});
+        }
+    }
+    return peaks;
+}
+
+auto ProjectionDetector::detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT>
+{
+    const int templHeight = matcher.templates()[LANE_LEFT].gray.rows;
+    const float threshold = std::max(request.threshold, PROFILE_THRESHOLD);
+    // the profile is cheap enough to scan the whole strip, so request.windows is not needed
+    std::array<std::vector<MatchPeak>, LANE_COUNT> peaks;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        peaks[i] = matchProfile(gray, request.search[i], i, threshold);
+    }
+    auto detections = toDetections(peaks, request, templHeight);
+    if (++frames % SANITY_PERIOD != 0)
+    {
+        return detections;
+    }
+
+    auto fullPeaks = matcher.matchPeaks(gray, request.search, request.threshold);
+    auto full = toDetections(fullPeaks, request, templHeight);
+    int frameChecked = 0, frameAgreed = 0;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        for (const auto &d : full[i])
+        {
+            ++frameChecked;
+            frameAgreed += std::any_of(detections[i].begin(), detections[i].end(), [&](const Detection &p)
+                                       { return std::abs(p.y - d.y) <= request.agreeDisp; });
+        }
+    }
+    checked += frameChecked;
+    agreed += frameAgreed;
+    if (frameAgreed < frameChecked)
+    {
+        logInfo("Projection check: 2-D", frameChecked, "profile agreed", frameAgreed, "total", agreed, "/", checked);
+    }
+    // the 2-D detections are exact and carry x for the column lock
+    return full;
+}
+
+auto TemplateBankDetector::prepareVariants(const std::vector<cv::Mat> &upTemplates) -> void
+{
+    variants.clear();
+    for (const auto &t : upTemplates)
+    {
+        // the loop sizes search bands and exit areas by templateSize while no variant is locked
+        if (t.size() != upTemplates.front().size())
+        {
+            logError("Template bank: skipping a", t.cols, "x", t.rows, "variant, all variants must be",
+                     upTemplates.front().cols, "x", upTemplates.front().rows);
+            continue;
+        }
+        variants.emplace_back(t);
+        variants.back().setEngine(MATCH_ENGINE_SPATIAL);
+    }
+    votes.assign(variants.size(), 0);
+    // a single variant has nothing to choose from
+    locked = variants.size() == 1 ? 0 : -1;
+    emptyFrames = 0;
+    logInfo("Template bank:", variants.size(), "variants");
+}
+
+auto TemplateBankDetector::matchVariant(const cv::Mat &gray, const FrameStats &stats, int variant, const DetectionRequest &request) const -> std::array<std::vector<Detection>, LANE_COUNT>
+{
+    const auto &matcher = variants[variant];
+    const int templHeight = matcher.templates()[LANE_LEFT].gray.rows;
+    std::array<std::vector<MatchPeak>, LANE_COUNT> peaks;
+    if (request.windows)
+    {
+        std::array<std::vector<cv::Range>, LANE_COUNT> rows;
+        for (int i = 0; i < LANE_COUNT; i++)
+        {
+            for (const auto &w : (*request.windows)[i])
+            {
+                rows[i].emplace_back(w.start - templHeight, w.end - templHeight);
+            }
+        }
+        peaks = matcher.matchPeaksInWindows(gray, stats, request.search, rows, request.threshold);
+    }
+    else
+    {
+        for (int i = 0; i < LANE_COUNT; i++)
+        {
+            peaks[i] = matchPeaksInRegion(gray, stats, matcher.templates()[i], request.search[i], request.threshold);
+        }
+    }
+    auto detections = toDetections(peaks, request, templHeight);
+    for (auto &lane : detections)
+    {
+        for (auto &d : lane)
+        {
+            d.variant = variant;
+        }
+    }
+    return detections;
+}
+
+auto TemplateBankDetector::vote(const std::array<std::vector<Detection>, LANE_COUNT> &detections) -> void
+{
+    for (const auto &lane : detections)
+    {
+        for (const auto &d : lane)
+        {
+            if (d.score >= CONFIDENT_SCORE)
+            {
+                ++votes[d.variant];
+            }
+        }
+    }
+    auto lead = std::max_element(votes.begin(), votes.end());
+    int total = 0;
+    for (int v : votes)
+    {
+        total += v;
+    }
+    if (*lead >= LOCK_VOTES && *lead >= LOCK_SHARE * total)
+    {
+        locked = int(lead - votes.begin());
+        logInfo("Template bank locked on variant", locked, "votes", *lead, "of", total);
+    }
+}
+
+auto TemplateBankDetector::detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT>
+{
+    // frame-side statistics are shared by every variant
+    const auto stats = computeFrameStats(gray);
+    if (locked >= 0)
+    {
+        auto detections = matchVariant(gray, stats, locked, request);
+        bool empty = std::all_of(detections.begin(), detections.end(), [](const auto &lane)
+                                 { return lane.empty(); });
+        emptyFrames = empty ? emptyFrames + 1 : 0;
+        if (variants.size() > 1 && emptyFrames >= UNLOCK_FRAMES)
+        {
+            logInfo("Template bank: variant", locked, "unlocked after", emptyFrames, "empty frames");
+            locked = -1;
+            emptyFrames = 0;
+            votes.assign(variants.size(), 0);
+        }
+        return detections;
+    }
+
+    std::array<std::vector<Detection>, LANE_COUNT> merged;
+    for (int v = 0; v < int(variants.size()); v++)
+    {
+        auto detections = matchVariant(gray, stats, v, request);
+        for (int i = 0; i < LANE_COUNT; i++)
+        {
+            merged[i].insert(merged[i].end(), detections[i].begin(), detections[i].end());
+        }
+    }
+    for (auto &lane : merged)
+    {
+        // overlapping detections of different variants keep the best score
+        std::stable_sort(lane.begin(), lane.end(), [](const Detection &a, const Detection &b)
+                         { return a.y < b.y; });
+        lane = suppressDetections(lane, request.dispY);
+    }
+    vote(merged);
+    return merged;
+}
@@ -0,0 +1,290 @@
+#pragma once
+#include "utils.h"
+#include "cv_utils.h"
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Per-frame input of a Detector.
+ *
+ * All coordinates are in the matchScale frame handed to Detector::detect.
+ */
+struct DetectionRequest
+{
+    std::array<cv::Rect, LANE_COUNT> lanes;  ///< Full lane regions; detection x is relative to these
+    std::array<cv::Rect, LANE_COUNT> search; ///< Searched part of each lane, e.g. narrowed by ColumnLock
+    std::array<int, LANE_COUNT> exitArea{};  ///< Last window row per lane; matches below it are ignored
+    /// Optional bottom Y ranges to search per lane (tracker predictions and entry band); nullptr searches everything
+    const std::array<std::vector<cv::Range>, LANE_COUNT> *windows = nullptr;
+    float threshold = 0.55f; ///< Minimum score of a detection
+    int dispY = LOCATION_DISP_Y; ///< Minimum distance of two detections of a lane, scaled with the frame
+    int agreeDisp = 3; ///< Max bottom Y difference of agreeing detections, see ProjectionDetector::AGREE_DISP
+};
+
+/**
+ * @brief Session options a Detector may honour.
+ */
+struct DetectorOptions
+{
+    int pyramidFactor = 0;     ///< Coarse-to-fine factor, see LaneMatcher::setPyramid
+    int anisotropicFactor = 0; ///< Horizontal reduction factor, see LaneMatcher::setAnisotropic and Detector::horizontalFactor
+};
+
+/**
+ * @brief A lane detection engine: prepares its templates once and turns frames into per-lane detections.
+ */
+class Detector
+{
+public:
+    virtual ~Detector() = default;
+
+    /**
+     * @brief Name under which the detector is registered.
+     */
+    virtual auto name() const -> const char * = 0;
+
+    /**
+     * @brief Prepares the templates of the up-arrow for all lanes.
+     *
+     * @param upTemplate The up-arrow template (gray, BGR or BGRA).
+     */
+    virtual auto prepare(const cv::Mat &upTemplate) -> void = 0;
+
+    /**
+     * @brief Prepares several variants of the up-arrow, e.g. the arrow art of different skins.
+     *
+     * Detectors without a template bank prepare the first variant only.
+     *
+     * @param upTemplates The variants; the first one is the built-in template.
+     */
+    virtual auto prepareVariants(const std::vector<cv::Mat> &upTemplates) -> void { prepare(upTemplates.front()); }
+
+    /**
+     * @brief Applies session options; options a detector does not support are ignored.
+     */
+    virtual auto configure(const DetectorOptions &options) -> void {}
+
+    /**
+     * @brief Size of the template matched in a lane.
+     */
+    virtual auto templateSize(int lane) const -> cv::Size = 0;
+
+    /**
+     * @brief Factor by which detect() expects frames to be downsampled in x.
+     *
+     * Set through DetectorOptions::anisotropicFactor by detectors that support it; the
+     * caller folds it into the resize it does anyway. 1 for uniformly scaled frames.
+     */
+    virtual auto horizontalFactor() const -> int { return 1; }
+
+    /**
+     * @brief Match time of each lane in the last detect(), in ms, for detectors that measure it.
+     */
+    virtual auto laneTimesMs() const -> std::optional<std::array<double, LANE_COUNT>> { return std::nullopt; }
+
+    /**
+     * @brief Processes one grayscale frame.
+     *
+     * @param gray The 8-bit grayscale frame at match scale.
+     * @param request Lane regions, exit areas and optional windows.
+     * @return The detections of each lane in Lane order, sorted by increasing y.
+     */
+    virtual auto detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT> = 0;
+};
+
+/**
+ * @brief Runtime registry of detector factories.
+ *
+ * The built-in detectors are registered on first use, in MatchEngine order, so their index
+ * is the same as the MatchEngine value stored in older config files.
+ */
+class DetectorRegistry
+{
+public:
+    using Factory = std::function<std::unique_ptr<Detector>()>;
+
+    static auto instance() -> DetectorRegistry &;
+
+    /**
+     * @brief Registers a detector factory; a name registered twice replaces the factory.
+     */
+    auto add(const std::string &name, Factory factory) -> void;
+
+    /**
+     * @brief Creates a detector by index, nullptr if out of range.
+     */
+    auto create(int index) const -> std::unique_ptr<Detector>;
+
+    /**
+     * @brief Index of a registered name, -1 if unknown.
+     */
+    auto indexOf(const std::string &name) const -> int;
+
+    auto names() const -> std::vector<std::string>;
+
+private:
+    DetectorRegistry();
+
+    std::vector<std::pair<std::string, Factory>> factories;
+};
+
+/**
+ * @brief Detector backed by LaneMatcher with a fixed correlation engine.
+ */
+class LaneMatcherDetector : public Detector
+{
+public:
+    LaneMatcherDetector(const char *name, MatchEngine engine) : detectorName{name}, engine{engine} {}
+
+    auto name() const -> const char * override { return detectorName; }
+    auto prepare(const cv::Mat &upTemplate) -> void override;
+    auto configure(const DetectorOptions &options) -> void override;
+    auto templateSize(int lane) const -> cv::Size override { return matcher.templates()[lane].size(); }
+    auto horizontalFactor() const -> int override { return matcher.anisotropicFactor(); }
+    auto laneTimesMs() const -> std::optional<std::array<double, LANE_COUNT>> override { return matcher.laneTimesMs(); }
+    auto detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT> override;
+
+private:
+    const char *detectorName;
+    MatchEngine engine;
+    LaneMatcher matcher;
+};
+
+/**
+ * @brief Counters of the cascade stages, accumulated since the last reset.
+ */
+struct CascadeStats
+{
+    int64_t frames = 0;
+    int64_t rows = 0;     ///< Window rows seen by stage 1
+    int64_t proposed = 0; ///< Window rows passed on to stage 2
+    int64_t verified = 0; ///< Peaks confirmed by stage 2
+    double stage1Ms = 0;  ///< Time spent in stage 1
+    double stage2Ms = 0;  ///< Time spent in stage 2
+
+    /**
+     * @brief Fraction of window rows rejected by stage 1.
+     */
+    auto rejection() const -> double { return rows ? 1.0 - double(proposed) / rows : 0.0; }
+};
+
+/**
+ * @brief Two-stage cascade: a gradient-energy row filter proposes candidate rows and
+ * TM_CCOEFF_NORMED verifies them at full resolution.
+ *
+ * Stage 1 counts strong horizontal gradients per strip row and sums them over the template
+ * height; window rows with less than ENERGY_RATIO of the template's own gradient count cannot
+ * hold an arrow and are dropped. Stage 2 correlates only the surviving row bands, so the match
+ * cost follows the number of arrows instead of the strip area.
+ */
+class CascadeDetector : public Detector
+{
+public:
+    static constexpr int GRADIENT_THRESHOLD = 24; ///< Minimum |I(x+1) - I(x)| of a strong gradient
+    static constexpr float ENERGY_RATIO = 0.6f;   ///< Share of the template gradient count a candidate needs
+    static constexpr int STATS_PERIOD = 200;      ///< Frames between two stats logs
+
+    auto name() const -> const char * override { return "cascade"; }
+    auto prepare(const cv::Mat &upTemplate) -> void override;
+    auto configure(const DetectorOptions &options) -> void override {}
+    auto templateSize(int lane) const -> cv::Size override { return matcher.templates()[lane].size(); }
+    auto detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT> override;
+
+    auto stats() const -> const CascadeStats & { return counters; }
+    auto resetStats() -> void { counters = {}; }
+
+private:
+    /**
+     * @brief Stage 1 of one lane: candidate window rows as merged ranges.
+     */
+    auto proposeRows(const cv::Mat &gray, cv::Rect region, int lane) const -> std::vector<cv::Range>;
+
+    LaneMatcher matcher;
+    std::array<int, LANE_COUNT> templEnergy{}; ///< Strong gradient count of each template rotation
+    CascadeStats counters;
+};
+
+/**
+ * @brief Row-projection matcher: correlates 1-D vertical profiles instead of 2-D windows.
+ *
+ * Each searched strip is collapsed into its per-row sums and matched against the row sums of
+ * the template with a zero-mean normalized correlation, O(H·h) per lane instead of O(H·W·h·w).
+ * The profile cannot tell where in the strip the arrow is, so detections carry x = -1 and do
+ * not feed the column lock. Every SANITY_PERIOD frames the full 2-D TM_CCOEFF_NORMED runs in
+ * its place, its detections are returned and the disagreement with the profile is logged.
+ */
+class ProjectionDetector : public Detector
+{
+public:
+    static constexpr float PROFILE_THRESHOLD = 0.9f; ///< Minimum profile score; 1-D profiles correlate easily
+    static constexpr int SANITY_PERIOD = 30;         ///< Frames between two 2-D checks
+    static constexpr int AGREE_DISP = 3;             ///< Max bottom Y difference of agreeing detections at the reference width
+
+    auto name() const -> const char * override { return "projection"; }
+    auto prepare(const cv::Mat &upTemplate) -> void override;
+    auto configure(const DetectorOptions &options) -> void override {}
+    auto templateSize(int lane) const -> cv::Size override { return matcher.templates()[lane].size(); }
+    auto detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT> override;
+
+private:
+    /**
+     * @brief Profile peaks of one lane, in increasing y; x is -1.
+     */
+    auto matchProfile(const cv::Mat &gray, cv::Rect region, int lane, float threshold) const -> std::vector<MatchPeak>;
+
+    LaneMatcher matcher;                                   ///< 2-D matcher of the sanity check
+    std::array<std::vector<float>, LANE_COUNT> templProfile; ///< Zero-mean, unit-norm row sums of each rotation
+    int64_t frames = 0;
+    int64_t checked = 0;  ///< 2-D detections seen by the sanity checks
+    int64_t agreed = 0;   ///< Of which the profile found too
+};
+
+/**
+ * @brief Matches a bank of template variants and locks onto the one on screen.
+ *
+ * Until a variant is locked, every variant is correlated in the same pass with one set of
+ * frame statistics, and overlapping detections of different variants keep the best score
+ * and its variant. Confident detections vote for their variant; once one variant leads
+ * clearly only its templates are matched, so the steady-state cost is that of a single
+ * template. The lock is released after UNLOCK_FRAMES frames without any detection.
+ *
+ * All variants must have the size of the built-in template; others are skipped when loading,
+ * so templateSize holds whichever variant a detection came from.
+ */
+class TemplateBankDetector : public Detector
+{
+public:
+    static constexpr float CONFIDENT_SCORE = 0.55f; ///< Score of a detection that votes for its variant
+    static constexpr int LOCK_VOTES = 12;           ///< Votes the leading variant needs to lock
+    static constexpr float LOCK_SHARE = 0.8f;       ///< Share of all votes the leading variant needs to lock
+    static constexpr int UNLOCK_FRAMES = 120;       ///< Frames without detections before all variants are matched again
+
+    auto name() const -> const char * override { return "bank"; }
+    auto prepare(const cv::Mat &upTemplate) -> void override { prepareVariants({upTemplate}); }
+    auto prepareVariants(const std::vector<cv::Mat> &upTemplates) -> void override;
+    auto configure(const DetectorOptions &options) -> void override {}
+    auto templateSize(int lane) const -> cv::Size override { return variants.front().templates()[lane].size(); }
+    auto detect(const cv::Mat &gray, const DetectionRequest &request) -> std::array<std::vector<Detection>, LANE_COUNT> override;
+
+    /**
+     * @brief The locked variant, -1 while all variants are matched.
+     */
+    auto lockedVariant() const -> int { return locked; }
+
+private:
+    /**
+     * @brief Detections of one variant, tagged with its index.
+     */
+    auto matchVariant(const cv::Mat &gray, const FrameStats &stats, int variant, const DetectionRequest &request) const -> std::array<std::vector<Detection>, LANE_COUNT>;
+
+    /**
+     * @brief Counts the votes of a frame and locks the leading variant when it is clear.
+     */
+    auto vote(const std::array<std::vector<Detection>, LANE_COUNT> &detections) -> void;
+
+    std::vector<LaneMatcher> variants;
+    std::vector<int> votes;
+    int locked = -1;
+    int emptyFrames = 0;
+};
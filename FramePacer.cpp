@@ -0,0 +1,144 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static auto toMs(std::chrono::steady_clock::duration d) -> double
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+FramePacer::FramePacer(double periodMs)
+    : period{std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(std::max(periodMs, 0.0)))}
+{
+#ifdef _WIN32
+    // Windows 10 1803+; older systems sleep with the multimedia timer resolution raised to 1 ms
+    timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer)
+    {
+        raisedResolution = timeBeginPeriod(1) == 0;
+    }
+#endif
+    restart();
+}
+
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+    if (timer)
+    {
+        CloseHandle(timer);
+    }
+    if (raisedResolution)
+    {
+        timeEndPeriod(1);
+    }
+#endif
+}
+
+auto FramePacer::periodMs() const -> double
+{
+    return toMs(period);
+}
+
+auto FramePacer::wait() -> void
+{
+    deadline += period;
+    auto now = Clock::now();
+    if (now >= deadline)
+    {
+        // the frame outlasted its period: start over from now instead of bursting to catch up
+        record(now, toMs(now - deadline), true);
+        deadline = now;
+        return;
+    }
+    sleepUntil(deadline - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(SPIN_MS)));
+    while ((now = Clock::now()) < deadline)
+    {
+        std::this_thread::yield();
+    }
+    record(now, toMs(now - deadline), false);
+}
+
+auto FramePacer::arrived() -> void
+{
+    const auto now = Clock::now();
+    deadline = now;
+    record(now, std::nullopt, false);
+}
+
+auto FramePacer::timedOut() -> void
+{
+    std::lock_guard lock(statsMutex);
+    ++totals.timeouts;
+}
+
+auto FramePacer::restart() -> void
+{
+    deadline = last = Clock::now();
+}
+
+auto FramePacer::sleepUntil(Clock::time_point until) -> void
+{
+    const auto remaining = until - Clock::now();
+    if (remaining <= Clock::duration::zero())
+    {
+        return;
+    }
+#ifdef _WIN32
+    if (timer)
+    {
+        LARGE_INTEGER due;
+        // relative due time in 100 ns units
+        due.QuadPart = -std::chrono::duration_cast<std::chrono::duration<long long, std::ratio<1, 10000000>>>(remaining).count();
+        if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE))
+        {
+            WaitForSingleObject(timer, INFINITE);
+            return;
+        }
+    }
+#endif
+    std::this_thread::sleep_until(until);
+}
+
+auto FramePacer::record(Clock::time_point now, std::optional<double> latenessMs, bool overrun) -> void
+{
+    std::lock_guard lock(statsMutex);
+    ++totals.frames;
+    if (overrun)
+    {
+        ++totals.overruns;
+    }
+    else if (latenessMs)
+    {
+        totals.meanLatenessMs += *latenessMs;
+        totals.maxLatenessMs = std::max(totals.maxLatenessMs, *latenessMs);
+        ++latenessCount;
+    }
+    const double interval = toMs(now - last);
+    totals.meanIntervalMs += interval;
+    totals.maxIntervalMs = std::max(totals.maxIntervalMs, interval);
+    ++intervalCount;
+    last = now;
+}
+
+auto FramePacer::stats() const -> PacingStats
+{
+    std::lock_guard lock(statsMutex);
+    PacingStats s = totals;
+    s.meanLatenessMs = latenessCount ? totals.meanLatenessMs / latenessCount : 0.0;
+    s.meanIntervalMs = intervalCount ? totals.meanIntervalMs / intervalCount : 0.0;
+    return s;
+}
+
+auto FramePacer::resetStats() -> void
+{
+    std::lock_guard lock(statsMutex);
+    totals = {};
+    latenessCount = 0;
+    intervalCount = 0;
+}
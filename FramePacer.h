@@ -0,0 +1,92 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+
+/**
+ * @brief What starts a capture.
+ */
+enum PacingMode
+{
+    PACING_PERIOD = 0,    ///< A FramePacer deadline every target period
+    PACING_FRAME_ARRIVAL  ///< The capture source presenting a new frame; falls back to the period
+};
+
+/**
+ * @brief Pacing statistics since the last reset.
+ */
+struct PacingStats
+{
+    int64_t frames = 0;
+    int64_t overruns = 0;      ///< Frames whose work outlasted the period; their deadline was skipped
+    int64_t timeouts = 0;      ///< Frame waits that timed out on a static screen, for PACING_FRAME_ARRIVAL
+    double meanLatenessMs = 0; ///< Mean wake-up after the deadline, overruns excluded
+    double maxLatenessMs = 0;
+    double meanIntervalMs = 0; ///< Mean time between two frames
+    double maxIntervalMs = 0;
+};
+
+/**
+ * @brief Paces a loop to a fixed period with a hybrid sleep-then-spin deadline wait.
+ *
+ * Deadlines advance by whole periods, so the error of one wait does not carry over to
+ * the next. A wait sleeps until SPIN_MS before the deadline, on a high-resolution
+ * waitable timer where Windows has one and with a 1 ms timer resolution otherwise, and
+ * yields in a loop for the rest. A frame that outlasts its period skips the missed
+ * deadline instead of catching up with a burst. Every frame records its lateness, the
+ * time the wait returned after the deadline, and its interval to the previous frame.
+ */
+class FramePacer
+{
+public:
+    static constexpr double SPIN_MS = 1.0; ///< Final part of a wait that is spun instead of slept
+
+    explicit FramePacer(double periodMs);
+    ~FramePacer();
+
+    FramePacer(const FramePacer &) = delete;
+    FramePacer &operator=(const FramePacer &) = delete;
+
+    auto periodMs() const -> double;
+
+    /**
+     * @brief Waits for the next deadline, one period after the previous one.
+     */
+    auto wait() -> void;
+
+    /**
+     * @brief Counts a frame that arrived on its own, for PACING_FRAME_ARRIVAL; only the interval is recorded.
+     */
+    auto arrived() -> void;
+
+    /**
+     * @brief Counts a wait for a new frame that timed out, for PACING_FRAME_ARRIVAL; no frame is recorded.
+     */
+    auto timedOut() -> void;
+
+    /**
+     * @brief Restarts the deadlines from now, e.g. after a pause.
+     */
+    auto restart() -> void;
+
+    auto stats() const -> PacingStats;
+    auto resetStats() -> void;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    auto sleepUntil(Clock::time_point until) -> void;
+    auto record(Clock::time_point now, std::optional<double> latenessMs, bool overrun) -> void;
+
+    Clock::duration period;
+    Clock::time_point deadline;
+    Clock::time_point last; ///< Time the previous frame started, or of the restart
+    void *timer = nullptr;  ///< High-resolution waitable timer, Windows only
+    bool raisedResolution = false;
+
+    mutable std::mutex statsMutex;
+    PacingStats totals; ///< Sums in the mean fields until stats() divides them
+    int64_t latenessCount = 0;
+    int64_t intervalCount = 0;
+};
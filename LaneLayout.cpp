@@ -0,0 +1,169 @@
+#include "LaneLayout.h"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+// exit line adjustments of the rotated templates, in reference pixels
+constexpr int LEFT_EXIT_ADJUST = 6;
+constexpr int RIGHT_EXIT_ADJUST = 9;
+
+static auto rotationByName(const std::string &name) -> int
+{
+    constexpr const char *names[LANE_COUNT] = {"left", "down", "up", "right"};
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        if (name == names[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static auto keyOfRotation(int rotation) -> int
+{
+    constexpr int keys[LANE_COUNT] = {VK_LEFT, VK_DOWN, VK_UP, VK_RIGHT};
+    return keys[rotation];
+}
+
+static auto keyByName(const std::string &name) -> int
+{
+    if (int rotation = rotationByName(name); rotation >= 0)
+    {
+        return keyOfRotation(rotation);
+    }
+    if (name.size() == 4 && name.compare(0, 3, "num") == 0 && std::isdigit(static_cast<unsigned char>(name[3])))
+    {
+        return VK_NUMPAD0 + (name[3] - '0');
+    }
+    if (name.size() == 1 && std::isalnum(static_cast<unsigned char>(name[0])))
+    {
+        // virtual key codes of letters and digits are their upper case ASCII codes
+        return std::toupper(static_cast<unsigned char>(name[0]));
+    }
+    return -1;
+}
+
+static auto laneSpec(int rotation, double x0, double x1) -> LaneSpec
+{
+    constexpr const char *names[LANE_COUNT] = {"left: ", "down: ", "up:    ", "right:"};
+    LaneSpec spec;
+    spec.name = names[rotation];
+    spec.x0 = x0;
+    spec.x1 = x1;
+    spec.rotation = rotation;
+    spec.key = keyOfRotation(rotation);
+    spec.exitAdjust = rotation == LANE_LEFT ? LEFT_EXIT_ADJUST : rotation == LANE_RIGHT ? RIGHT_EXIT_ADJUST : 0;
+    return spec;
+}
+
+auto LaneLayout::standard() -> LaneLayout
+{
+    LaneLayout layout;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        layout.lanes.push_back(laneSpec(i, i / double(LANE_COUNT), (i + 1) / double(LANE_COUNT)));
+    }
+    return layout;
+}
+
+auto LaneLayout::parse(const std::string &spec) -> std::optional<LaneLayout>
+{
+    std::vector<std::string> tokens;
+    std::stringstream ss(spec);
+    for (std::string token; std::getline(ss, token, ',');)
+    {
+        token.erase(std::remove_if(token.begin(), token.end(), [](unsigned char c)
+                                   { return std::isspace(c); }),
+                    token.end());
+        std::transform(token.begin(), token.end(), token.begin(), [](unsigned char c)
+                       { return char(std::tolower(c)); });
+        if (token.empty())
+        {
+            return std::nullopt;
+        }
+        tokens.push_back(token);
+    }
+    if (tokens.empty())
+    {
+        return std::nullopt;
+    }
+    LaneLayout layout;
+    const int count = int(tokens.size());
+    for (int i = 0; i < count; i++)
+    {
+        const auto &token = tokens[i];
+        const auto at = token.find('@');
+        const auto eq = token.find('=');
+        int rotation = rotationByName(token.substr(0, std::min(at, eq)));
+        if (rotation < 0)
+        {
+            logError("Lane layout: unknown rotation in", token);
+            return std::nullopt;
+        }
+        auto lane = laneSpec(rotation, i / double(count), (i + 1) / double(count));
+        if (at != std::string::npos)
+        {
+            const auto extent = token.substr(at + 1, eq == std::string::npos ? std::string::npos : eq - at - 1);
+            const auto dash = extent.find('-');
+            try
+            {
+                lane.x0 = std::stod(extent.substr(0, dash)) / 100.0;
+                lane.x1 = std::stod(extent.substr(dash + 1)) / 100.0;
+            }
+            catch (...)
+            {
+                lane.x1 = -1; // rejected below
+            }
+            if (dash == std::string::npos || lane.x0 < 0 || lane.x1 > 1 || lane.x0 >= lane.x1)
+            {
+                logError("Lane layout: bad extent in", token);
+                return std::nullopt;
+            }
+        }
+        if (eq != std::string::npos)
+        {
+            lane.key = keyByName(token.substr(eq + 1));
+            if (lane.key < 0)
+            {
+                logError("Lane layout: unknown key in", token);
+                return std::nullopt;
+            }
+        }
+        layout.lanes.push_back(lane);
+    }
+    return layout;
+}
+
+auto LaneLayout::regions(cv::Size frameSize) const -> std::vector<cv::Rect>
+{
+    std::vector<cv::Rect> result;
+    result.reserve(lanes.size());
+    for (const auto &lane : lanes)
+    {
+        // same rounding as splitLanes, so the standard layout gives the same strips
+        int x = int(frameSize.width * lane.x0);
+        int width = int(frameSize.width * (lane.x1 - lane.x0));
+        result.emplace_back(x, 0, std::max(std::min(width, frameSize.width - x), 0), frameSize.height);
+    }
+    return result;
+}
+
+auto LaneLayout::batches() const -> std::vector<std::array<int, LANE_COUNT>>
+{
+    std::vector<std::array<int, LANE_COUNT>> result;
+    std::array<int, LANE_COUNT> used{};
+    for (int i = 0; i < size(); i++)
+    {
+        // the n-th lane of a rotation goes to batch n
+        const int rotation = lanes[i].rotation;
+        if (used[rotation] == int(result.size()))
+        {
+            std::array<int, LANE_COUNT> empty;
+            empty.fill(-1);
+            result.push_back(empty);
+        }
+        result[used[rotation]++][rotation] = i;
+    }
+    return result;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "utils.h"
+#include "cv_utils.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief One lane of the play field.
+ */
+struct LaneSpec
+{
+    std::string name;        ///< Name used in logs
+    double x0 = 0;           ///< Left edge as a fraction of the frame width
+    double x1 = 1;           ///< Right edge as a fraction of the frame width
+    int rotation = LANE_UP;  ///< Template rotation matched in the lane (Lane)
+    int key = VK_UP;         ///< Virtual key pressed when an arrow passes
+    int exitAdjust = 0;      ///< Rows the exit line is raised by, in reference pixels
+};
+
+/**
+ * @brief Configurable lane layout: N lanes with their x-extent, template rotation and key.
+ *
+ * Detectors match up to LANE_COUNT lanes per call, one per template rotation, so the
+ * layout is split into batches that each hold at most one lane of every rotation. Batches
+ * get their own detector instance and run in parallel.
+ */
+class LaneLayout
+{
+public:
+    /**
+     * @brief The four lanes of the standard chart: left, down, up, right.
+     */
+    static auto standard() -> LaneLayout;
+
+    /**
+     * @brief Parses a layout: comma separated lanes of the form rotation[@x0-x1][=key].
+     *
+     * rotation is left, down, up or right; x0-x1 is the extent in percent of the frame width,
+     * by default an equal share; key is left, down, up, right, num0..num9 or a single letter
+     * or digit, by default the arrow key of the rotation. "left,down,up,right" is the standard layout.
+     *
+     * @return The layout, or nothing if the text is malformed.
+     */
+    static auto parse(const std::string &spec) -> std::optional<LaneLayout>;
+
+    auto size() const -> int { return int(lanes.size()); }
+    auto operator[](int lane) const -> const LaneSpec & { return lanes[lane]; }
+
+    /**
+     * @brief The lane regions of a frame, clamped to it.
+     */
+    auto regions(cv::Size frameSize) const -> std::vector<cv::Rect>;
+
+    /**
+     * @brief Groups lanes for the detectors: entry r of a batch is the lane matched with rotation r, -1 if none.
+     */
+    auto batches() const -> std::vector<std::array<int, LANE_COUNT>>;
+
+private:
+    std::vector<LaneSpec> lanes;
+};
@@ -5,7 +5,10 @@
 #include <iterator>
 #include <sstream>
 #include <deque>
+#include <atomic>
 #include "utils.h"
+#include "Detection.h"
+#include <opencv2/core/types.hpp>
 
 const int IGNORE_DISP = 17;
 class LaneObj
@@ -15,6 +18,8 @@ public:
 
     std::uint32_t getId() const { return id; }
     int getPos() const { return pos; }
+    float getSpeed() const { return speedPerMS; }
+    void setSpeed(float speed) { speedPerMS = speed; }
 
     int getPotentialPos(long long loss_time=10) const
     {
@@ -72,13 +77,9 @@ class NaiveTracker
 private:
     int getNewId() const
     {
-        static int id = 0;
-        id++;
-        if (id > 1000)
-        {
-            id = 0;
-        }
-        return id;
+        // shared by the lanes, which are tracked in parallel; counts 1..1000, 0, 1, ...
+        static std::atomic<std::uint32_t> id{0};
+        return int(++id % 1001);
     }
 
 public:
@@ -91,12 +92,115 @@ public:
         exitAreaY = y;
     }
 
+    /*
+     * @method setIgnoreDisp
+     * @brief Backward displacement still matched to a tracked object, IGNORE_DISP scaled with the frame.
+     */
+    void setIgnoreDisp(int disp)
+    {
+        ignoreDisp = disp;
+    }
+
+    /*
+     * @method setSpawnScore
+     * @brief Minimum score for a scored detection to start a new tracked object.
+     * Weaker detections can still continue objects that are already tracked.
+     */
+    void setSpawnScore(float score)
+    {
+        spawnScore = score;
+    }
+
+    /*
+     * @method setScrollSpeed
+     * @brief Global scroll speed in pixels per ms, shared by all arrows of a song.
+     * When positive it replaces the speed each object estimates on its own; 0 restores them.
+     */
+    void setScrollSpeed(float speedPerMS)
+    {
+        scrollSpeed = speedPerMS;
+    }
+
+    /*
+     * @method propagate
+     * @brief Bottom Y of the tracked objects moved by a displacement, in increasing order.
+     */
+    auto propagate(int dy) const -> std::vector<int>
+    {
+        std::vector<int> positions;
+        positions.reserve(lane.size());
+        for (auto &el : lane)
+        {
+            positions.push_back(el.getPos() + dy);
+        }
+        return positions;
+    }
+
     /*
      * @method updateTracker
      * @brief Updates the tracker with new detections. WARN: Expects sorted detections. inreasing order
      * @param detections A vector of detections to update the tracker with.
      */
     auto updateTracker(const std::vector<int> &detections, long long ts) -> bool
+    {
+        return updateLane(detections, ts, [](size_t) { return true; });
+    }
+
+    /*
+     * @method updateTracker
+     * @brief Updates the tracker with scored detections. WARN: Expects sorted detections. inreasing order
+     * Detections below the spawn score are only used to follow tracked objects.
+     * @param detections A vector of detections to update the tracker with.
+     */
+    auto updateTracker(const std::vector<Detection> &detections, long long ts) -> bool
+    {
+        std::vector<int> positions;
+        positions.reserve(detections.size());
+        for (auto &d : detections)
+        {
+            positions.push_back(d.y);
+        }
+        return updateLane(positions, ts, [&](size_t i) { return detections[i].score >= spawnScore; });
+    }
+
+    /*
+     * @method predictWindows
+     * @brief Predicted bottom Y ranges of the tracked objects at ts.
+     * Objects without a speed yet get a window reaching further down, as arrows only move down.
+     * @param margin Half height of the window around a prediction.
+     */
+    auto predictWindows(long long ts, int margin) const -> std::vector<cv::Range>
+    {
+        std::vector<cv::Range> windows;
+        windows.reserve(lane.size());
+        for (auto &el : lane)
+        {
+            if (el.getSpeed() > 0)
+            {
+                int p = el.getPotentialPos(ts - last_time);
+                windows.emplace_back(p - margin, p + margin + 1);
+            }
+            else
+            {
+                windows.emplace_back(el.getPos() - margin, el.getPos() + 4 * margin + 1);
+            }
+        }
+        return windows;
+    }
+
+    static void printDetections(const std::string &msg, const std::vector<Detection> &detections)
+    {
+        std::stringstream ss;
+        for (auto &d : detections)
+        {
+            ss << d.y << "(" << d.score << "),";
+        }
+        logInfo(msg, ss.str());
+    }
+
+private:
+    template <typename CanSpawn>
+    auto updateLane(const std::vector<int> &detections, long long ts, CanSpawn canSpawn) -> bool
     {
         std::deque<LaneObj> matchedTrackers;
         // imagine we have tracked obj positions [3,4,7,8] and detections [1,2, 10, 20]
@@ -117,7 +221,7 @@ public:
             if (detections.size() - matchedTrackers.size() > 0)
             {
                 // upper bound does not check the range, we have to be sure ourself
-                upper = std::upper_bound(detections.begin(), detections.begin() + detections.size() - matchedTrackers.size(), l.getPos() - IGNORE_DISP);
+                upper = std::upper_bound(detections.begin(), detections.begin() + detections.size() - matchedTrackers.size(), l.getPos() - ignoreDisp);
             }
             if (upper == detections.end())
             {
@@ -159,9 +263,10 @@ public:
             // as we will consider them as new objects if they are above the exit area
             for (int i = 0; i < newElementsCount; i++)
             {
-                if (detections[i] < exitAreaY)
+                if (detections[i] < exitAreaY && canSpawn(i))
                 {
                     lane.push_back(LaneObj(getNewId(), detections[i], ts));
+                    lane.back().setSpeed(scrollSpeed);
                 }
             }
         }
@@ -172,6 +277,10 @@ public:
         for (auto &el : matchedTrackers)
         {
             el.setPos(detections[newElementsCount], ts);
+            if (scrollSpeed > 0)
+            {
+                el.setSpeed(scrollSpeed);
+            }
             if (el.getPotentialPos(potential_future_loss/3) > exitAreaY && !el.isPassed())
             {
                 logInfo(name, "Object ", el.getId(), " passed at ", ts, "area ", exitAreaY);
@@ -185,6 +294,7 @@ public:
         return passed;
     }
 
+public:
     static void printDetections(const std::string &msg, const std::vector<int> &detections)
     {
         std::stringstream ss;
@@ -237,4 +347,7 @@ private:
     long long last_time=0;
     // std::vector<LaneObj> unmatchedTrackersReverse;
     int exitAreaY;
+    float spawnScore = 0;
+    float scrollSpeed = 0;
+    int ignoreDisp = IGNORE_DISP;
 };
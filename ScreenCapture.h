@@ -24,4 +24,11 @@ public:
      * @return A cv::Mat object containing the captured screen region.
      */
     virtual std::optional<cv::Mat> grabScreen(RECT region) = 0;
+
+    /**
+     * @brief Makes grabScreen wait for the next new frame instead of returning at once.
+     * @param timeoutMs Longest wait of a grab; a grab that times out returns no frame.
+     * @return false if the capture source cannot signal new frames.
+     */
+    virtual auto setFrameWait(int timeoutMs) -> bool { return false; }
 };
@@ -0,0 +1,253 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stop_token>
+
+/**
+ * @brief Counters of an SpscRing, readable from any thread.
+ */
+struct RingStats
+{
+    uint64_t pushed = 0;   ///< Items accepted by push
+    uint64_t dropped = 0;  ///< Items refused by push because the ring was full
+    uint64_t skipped = 0;  ///< Items of a LatestSlot overwritten by push before they were taken
+    double occupancy = 0;  ///< Mean number of queued items seen by the consumer; SpscRing only
+    size_t capacity = 0;
+};
+
+/**
+ * @brief Lock-free single-producer single-consumer ring connecting two pipeline stages.
+ *
+ * One thread pushes and one thread pops, in order. A full ring refuses new items, so it
+ * suits in-order queues; frames that must never wait behind older ones go through a
+ * LatestSlot instead. A consumer without data blocks in wait() on an atomic signal until
+ * the producer pushes or the ring is closed.
+ *
+ * @tparam T Item type, moved in and out.
+ * @tparam Capacity Number of slots, a power of two.
+ */
+template <typename T, size_t Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    /**
+     * @brief Producer: appends an item; a full ring refuses it and counts a drop.
+     */
+    auto push(T item) -> bool
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == Capacity)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[h & MASK] = std::move(item);
+        head.store(h + 1, std::memory_order_release);
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        notify();
+        return true;
+    }
+
+    /**
+     * @brief Consumer: takes the oldest item.
+     */
+    auto pop() -> std::optional<T>
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t h = head.load(std::memory_order_acquire);
+        if (t == h)
+        {
+            return std::nullopt;
+        }
+        sample(h - t);
+        std::optional<T> item{std::move(slots[t & MASK])};
+        tail.store(t + 1, std::memory_order_release);
+        return item;
+    }
+
+    /**
+     * @brief Consumer: blocks until an item is queued, the ring is closed or stop is requested.
+     *
+     * @return true if an item can be popped.
+     */
+    auto wait(std::stop_token stopToken) -> bool
+    {
+        // wake the waiter when stop is requested, like close()
+        std::stop_callback wake(stopToken, [this]
+                                { notify(); });
+        while (true)
+        {
+            const uint32_t seen = signal.load(std::memory_order_acquire);
+            if (tail.load(std::memory_order_relaxed) != head.load(std::memory_order_acquire))
+            {
+                return true;
+            }
+            if (closed.load(std::memory_order_acquire) || stopToken.stop_requested())
+            {
+                return false;
+            }
+            signal.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    /**
+     * @brief Ends the stream: waiting consumers return once the ring is drained. Callable from any thread.
+     */
+    auto close() -> void
+    {
+        closed.store(true, std::memory_order_release);
+        notify();
+    }
+
+    auto isClosed() const -> bool { return closed.load(std::memory_order_acquire); }
+
+    auto stats() const -> RingStats
+    {
+        RingStats s;
+        s.pushed = pushed.load(std::memory_order_relaxed);
+        s.dropped = dropped.load(std::memory_order_relaxed);
+        const uint64_t n = samples.load(std::memory_order_relaxed);
+        s.occupancy = n ? double(occupancySum.load(std::memory_order_relaxed)) / n : 0.0;
+        s.capacity = Capacity;
+        return s;
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    auto notify() -> void
+    {
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_all();
+    }
+
+    auto sample(size_t queued) -> void
+    {
+        occupancySum.fetch_add(queued, std::memory_order_relaxed);
+        samples.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::array<T, Capacity> slots{};
+    // producer and consumer indices on their own cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<uint32_t> signal{0};
+    std::atomic<bool> closed{false};
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> occupancySum{0};
+    std::atomic<uint64_t> samples{0};
+};
+
+/**
+ * @brief Lock-free single-producer single-consumer mailbox holding only the newest item.
+ *
+ * A triple buffer: the producer fills its back slot and swaps it with the shared middle
+ * slot by an atomic exchange, the consumer swaps its front slot with the middle one. A
+ * push never fails; an item the consumer has not taken yet is overwritten and counted as
+ * skipped, so a slow consumer always gets the latest frame. wait() and close() behave like
+ * those of SpscRing.
+ *
+ * @tparam T Item type, moved in and out.
+ */
+template <typename T>
+class LatestSlot
+{
+public:
+    /**
+     * @brief Producer: publishes an item, replacing one that was not taken yet.
+     */
+    auto push(T item) -> void
+    {
+        slots[back] = std::move(item);
+        const uint32_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = previous & INDEX;
+        if (previous & FRESH)
+        {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        notify();
+    }
+
+    /**
+     * @brief Consumer: takes the newest item if one was published since the last call.
+     */
+    auto popLatest() -> std::optional<T>
+    {
+        if (!(middle.load(std::memory_order_acquire) & FRESH))
+        {
+            return std::nullopt;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return std::optional<T>{std::move(slots[front])};
+    }
+
+    /**
+     * @brief Consumer: blocks until an item is published, the slot is closed or stop is requested.
+     *
+     * @return true if an item can be popped.
+     */
+    auto wait(std::stop_token stopToken) -> bool
+    {
+        std::stop_callback wake(stopToken, [this]
+                                { notify(); });
+        while (true)
+        {
+            const uint32_t seen = signal.load(std::memory_order_acquire);
+            if (middle.load(std::memory_order_acquire) & FRESH)
+            {
+                return true;
+            }
+            if (closed.load(std::memory_order_acquire) || stopToken.stop_requested())
+            {
+                return false;
+            }
+            signal.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    /**
+     * @brief Ends the stream: waiting consumers return once the last item is taken. Callable from any thread.
+     */
+    auto close() -> void
+    {
+        closed.store(true, std::memory_order_release);
+        notify();
+    }
+
+    auto isClosed() const -> bool { return closed.load(std::memory_order_acquire); }
+
+    auto stats() const -> RingStats
+    {
+        RingStats s;
+        s.pushed = pushed.load(std::memory_order_relaxed);
+        s.skipped = skipped.load(std::memory_order_relaxed);
+        s.capacity = 1;
+        return s;
+    }
+
+private:
+    static constexpr uint32_t INDEX = 3;
+    static constexpr uint32_t FRESH = 4; ///< Set in middle while it holds an item not taken yet
+
+    auto notify() -> void
+    {
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_all();
+    }
+
+    std::array<T, 3> slots{};
+    uint32_t back = 0;  ///< Producer only
+    uint32_t front = 2; ///< Consumer only
+    alignas(64) std::atomic<uint32_t> middle{1};
+    alignas(64) std::atomic<uint32_t> signal{0};
+    std::atomic<bool> closed{false};
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> skipped{0};
+};
@@ -0,0 +1,174 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <sstream>
+
+auto TaskGraph::add(std::string name, Task task, const std::vector<int> &deps) -> int
+{
+    const int index = int(nodes.size());
+    Node node{std::move(name), std::move(task)};
+    for (int d : deps)
+    {
+        if (d < 0 || d >= index)
+        {
+            logError("TaskGraph: node", node.name, "has an invalid dependency", d);
+            continue;
+        }
+        node.deps.push_back(d);
+        nodes[d].successors.push_back(index);
+    }
+    nodes.push_back(std::move(node));
+    return index;
+}
+
+auto TaskGraph::addSpan(int node, std::string name, double ms) -> void
+{
+    nodes[node].spans.emplace_back(std::move(name), ms);
+}
+
+auto TaskGraph::clear() -> void
+{
+    nodes.clear();
+}
+
+auto TaskGraph::run() -> void
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+    pending = std::vector<std::atomic<int>>(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        pending[i] = int(nodes[i].deps.size());
+        nodes[i].spans.clear();
+    }
+    failed = false;
+    error = nullptr;
+    remaining = int(nodes.size());
+    runStart = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].deps.empty())
+        {
+            pool.submit([this, i]
+                        { execute(int(i)); },
+                        remaining);
+        }
+    }
+    pool.helpUntil(remaining);
+    recordTimings();
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+auto TaskGraph::execute(int node) -> void
+{
+    auto &n = nodes[node];
+    n.startMs = elapsedMs();
+    if (!failed)
+    {
+        try
+        {
+            n.task();
+        }
+        catch (...)
+        {
+            std::lock_guard lock(errorMutex);
+            if (!failed)
+            {
+                error = std::current_exception();
+                failed = true;
+            }
+        }
+    }
+    n.endMs = elapsedMs();
+    for (int s : n.successors)
+    {
+        if (--pending[s] == 0)
+        {
+            pool.submit([this, s]
+                        { execute(s); },
+                        remaining);
+        }
+    }
+    pool.finish(remaining);
+}
+
+auto TaskGraph::elapsedMs() const -> double
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+}
+
+auto TaskGraph::recordTimings() -> void
+{
+    const double wall = elapsedMs();
+    // nodes are in topological order: the longest chain ending in each node in one pass
+    std::vector<double> finish(nodes.size(), 0.0);
+    std::vector<int> via(nodes.size(), -1);
+    int last = 0;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        double before = 0;
+        for (int d : nodes[i].deps)
+        {
+            if (finish[d] > before)
+            {
+                before = finish[d];
+                via[i] = d;
+            }
+        }
+        const double ms = nodes[i].endMs - nodes[i].startMs;
+        finish[i] = before + ms;
+        if (finish[i] > finish[last])
+        {
+            last = int(i);
+        }
+        auto &t = nodeTimings[nodes[i].name];
+        ++t.runs;
+        t.totalMs += ms;
+        t.maxMs = std::max(t.maxMs, ms);
+        for (const auto &[span, spanMs] : nodes[i].spans)
+        {
+            auto &s = nodeTimings[span];
+            ++s.runs;
+            s.totalMs += spanMs;
+            s.maxMs = std::max(s.maxMs, spanMs);
+        }
+    }
+    for (int i = last; i >= 0; i = via[i])
+    {
+        ++nodeTimings[nodes[i].name].critical;
+        // the slowest part of a critical node is what bounds it
+        const auto &spans = nodes[i].spans;
+        auto slowest = std::max_element(spans.begin(), spans.end(), [](const auto &a, const auto &b)
+                                        { return a.second < b.second; });
+        if (slowest != spans.end())
+        {
+            ++nodeTimings[slowest->first].critical;
+        }
+    }
+    ++runs;
+    criticalSum += finish[last];
+    wallSum += wall;
+}
+
+auto TaskGraph::logTimings() const -> void
+{
+    std::stringstream ss;
+    for (const auto &[name, t] : nodeTimings)
+    {
+        ss << name << ": " << t.meanMs() << "/" << t.maxMs << "ms critical " << t.critical << "/" << t.runs << "; ";
+    }
+    logInfo("Task graph: threads", threads(), "wall", wallMs(), "ms critical path", criticalPathMs(), "ms |", ss.str());
+}
+
+auto TaskGraph::resetTimings() -> void
+{
+    nodeTimings.clear();
+    runs = 0;
+    criticalSum = 0;
+    wallSum = 0;
+}
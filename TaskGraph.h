@@ -0,0 +1,131 @@
+#pragma once
+#include "utils.h"
+#include "WorkerPool.h"
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Timings of a task graph node, accumulated over the runs since the last reset.
+ */
+struct NodeTiming
+{
+    int64_t runs = 0;
+    int64_t critical = 0; ///< Runs in which the node was on the critical path
+    double totalMs = 0;
+    double maxMs = 0;
+
+    auto meanMs() const -> double { return runs ? totalMs / runs : 0.0; }
+};
+
+/**
+ * @brief Small executor of a dependency graph of tasks on a WorkerPool.
+ *
+ * Nodes are added in topological order, each with the nodes it depends on. run() submits the
+ * nodes without dependencies and every finished node submits its released successors from the
+ * thread that finished it, so they land on that thread's own deque and are stolen by idle
+ * threads. The calling thread runs jobs of the pool until the graph is done.
+ *
+ * Every node is timed; nodes with the same name share their timings across runs, so a graph
+ * rebuilt every frame still accumulates per-node statistics and its critical path. A node doing
+ * several independent parts at once can report them with addSpan.
+ */
+class TaskGraph
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit TaskGraph(WorkerPool &pool) : pool{pool} {}
+
+    TaskGraph(const TaskGraph &) = delete;
+    TaskGraph &operator=(const TaskGraph &) = delete;
+
+    /**
+     * @brief Adds a node.
+     *
+     * @param name Name of the node in the timings.
+     * @param task Work of the node.
+     * @param deps Nodes that must finish first; only nodes added before are valid.
+     * @return The index of the node.
+     */
+    auto add(std::string name, Task task, const std::vector<int> &deps = {}) -> int;
+
+    /**
+     * @brief Records a part of a node's work that the node timed itself, such as one lane of
+     * a batched match.
+     *
+     * Spans get their own timings under their name; when the node is on the critical path its
+     * longest span counts as critical too. Only the task of the node may call this, during run().
+     *
+     * @param node Index of the running node.
+     * @param name Name of the span in the timings.
+     * @param ms Time of the span.
+     */
+    auto addSpan(int node, std::string name, double ms) -> void;
+
+    /**
+     * @brief Removes all nodes; the timings are kept.
+     */
+    auto clear() -> void;
+
+    /**
+     * @brief Runs all nodes and returns when they are done.
+     *
+     * The first exception of a node is rethrown once the graph has stopped; nodes that had
+     * not started by then are skipped.
+     */
+    auto run() -> void;
+
+    auto threads() const -> int { return pool.threads(); }
+
+    auto timings() const -> const std::map<std::string, NodeTiming> & { return nodeTimings; }
+
+    /**
+     * @brief Mean critical path, the longest chain of dependent node times, per run.
+     */
+    auto criticalPathMs() const -> double { return runs ? criticalSum / runs : 0.0; }
+
+    /**
+     * @brief Mean wall time per run.
+     */
+    auto wallMs() const -> double { return runs ? wallSum / runs : 0.0; }
+
+    auto logTimings() const -> void;
+    auto resetTimings() -> void;
+
+private:
+    struct Node
+    {
+        std::string name;
+        Task task;
+        std::vector<int> deps;
+        std::vector<int> successors;
+        std::vector<std::pair<std::string, double>> spans;
+        double startMs = 0;
+        double endMs = 0;
+    };
+
+    auto execute(int node) -> void;
+    auto elapsedMs() const -> double;
+    auto recordTimings() -> void;
+
+    WorkerPool &pool;
+    std::vector<Node> nodes;
+    std::vector<std::atomic<int>> pending; ///< Unfinished dependencies per node during a run
+    std::atomic<int> remaining{0};
+    std::atomic<bool> failed{false};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::chrono::steady_clock::time_point runStart;
+
+    std::map<std::string, NodeTiming> nodeTimings;
+    int64_t runs = 0;
+    double criticalSum = 0;
+    double wallSum = 0;
+};
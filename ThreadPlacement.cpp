@@ -0,0 +1,184 @@
+#include "ThreadPlacement.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+auto coreCount() -> int
+{
+    return std::clamp(int(std::thread::hardware_concurrency()), 1, 64);
+}
+
+#ifdef _WIN32
+
+static auto pinCurrentThread(uint64_t cores) -> bool
+{
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(cores)) != 0;
+}
+
+static auto scheduleCurrentThread(int scheduling) -> bool
+{
+    // the thread priority only; the process keeps its priority class
+    constexpr int priorities[] = {THREAD_PRIORITY_NORMAL, THREAD_PRIORITY_HIGHEST, THREAD_PRIORITY_TIME_CRITICAL};
+    return SetThreadPriority(GetCurrentThread(), priorities[scheduling]) != 0;
+}
+
+#else
+
+static auto pinCurrentThread(uint64_t cores) -> bool
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < 64; i++)
+    {
+        if (cores >> i & 1)
+        {
+            CPU_SET(i, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+static auto scheduleCurrentThread(int scheduling) -> bool
+{
+    sched_param param{};
+    if (scheduling == SCHEDULING_REALTIME)
+    {
+        param.sched_priority = REALTIME_PRIORITY;
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+    if (pthread_setschedparam(pthread_self(), SCHED_OTHER, &param) != 0)
+    {
+        return false;
+    }
+    // Linux applies the nice value of a thread id to that thread only
+    return setpriority(PRIO_PROCESS, id_t(gettid()), scheduling == SCHEDULING_HIGH ? HIGH_NICE : 0) == 0;
+}
+
+#endif
+
+static auto onlineCores() -> uint64_t
+{
+    const int n = coreCount();
+    return n == 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+}
+
+auto applyThreadPlacement(const ThreadPlacement &placement) -> PlacementResult
+{
+    PlacementResult result;
+    result.pinned = pinCurrentThread(placement.cores ? placement.cores : onlineCores());
+    // normal always succeeds: it only lowers the priority
+    for (int s = std::clamp(placement.scheduling, int(SCHEDULING_NORMAL), int(SCHEDULING_REALTIME)); s >= SCHEDULING_NORMAL; s--)
+    {
+        if (scheduleCurrentThread(s))
+        {
+            result.scheduling = s;
+            break;
+        }
+    }
+    return result;
+}
+
+auto workerCores(uint64_t detectionCores) -> uint64_t
+{
+    const uint64_t rest = onlineCores() & ~detectionCores;
+    return detectionCores == 0 || rest == 0 ? 0 : rest;
+}
+
+auto parseCoreList(const std::string &list) -> std::optional<uint64_t>
+{
+    uint64_t cores = 0;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        int first = 0, last = 0;
+        char dash = 0, rest = 0;
+        std::stringstream is(item);
+        if (!(is >> first))
+        {
+            return std::nullopt;
+        }
+        last = first;
+        if (is >> dash && (dash != '-' || !(is >> last)))
+        {
+            return std::nullopt;
+        }
+        if (is >> rest || first < 0 || last < first || last > 63)
+        {
+            return std::nullopt;
+        }
+        for (int i = first; i <= last; i++)
+        {
+            cores |= uint64_t{1} << i;
+        }
+    }
+    if (cores == 0)
+    {
+        return std::nullopt;
+    }
+    return cores;
+}
+
+auto formatCoreList(uint64_t cores) -> std::string
+{
+    if (cores == 0)
+    {
+        return "all";
+    }
+    std::string list;
+    for (int i = 0; i < 64; i++)
+    {
+        if (!(cores >> i & 1))
+        {
+            continue;
+        }
+        int last = i;
+        while (last + 1 < 64 && (cores >> (last + 1) & 1))
+        {
+            ++last;
+        }
+        if (!list.empty())
+        {
+            list += ",";
+        }
+        list += last > i ? std::to_string(i) + "-" + std::to_string(last) : std::to_string(i);
+        i = last;
+    }
+    return list;
+}
+
+auto parseScheduling(const std::string &name) -> std::optional<int>
+{
+    constexpr const char *names[] = {"normal", "high", "realtime"};
+    for (int s = SCHEDULING_NORMAL; s <= SCHEDULING_REALTIME; s++)
+    {
+        if (name == names[s] || name == std::to_string(s))
+        {
+            return s;
+        }
+    }
+    return std::nullopt;
+}
+
+auto schedulingName(int scheduling) -> const char *
+{
+    switch (scheduling)
+    {
+    case SCHEDULING_HIGH:
+        return "high";
+    case SCHEDULING_REALTIME:
+        return "realtime";
+    default:
+        return "normal";
+    }
+}
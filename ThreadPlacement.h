@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// No GUI or OpenCV dependency: the Linux implementation builds and runs headless.
+
+/**
+ * @brief Scheduling class of the latency-critical threads.
+ */
+enum SchedulingClass
+{
+    SCHEDULING_NORMAL = 0, ///< The default class of the OS
+    SCHEDULING_HIGH,       ///< THREAD_PRIORITY_HIGHEST on Windows, nice HIGH_NICE on Linux
+    SCHEDULING_REALTIME    ///< THREAD_PRIORITY_TIME_CRITICAL on Windows, SCHED_FIFO on Linux
+};
+
+/**
+ * @brief Where and how a thread runs.
+ */
+struct ThreadPlacement
+{
+    uint64_t cores = 0;                 ///< Bit i allows core i; 0 for all cores
+    int scheduling = SCHEDULING_NORMAL; ///< SchedulingClass
+
+    auto operator==(const ThreadPlacement &) const -> bool = default;
+};
+
+/**
+ * @brief What applyThreadPlacement achieved.
+ */
+struct PlacementResult
+{
+    bool pinned = false;                ///< Affinity set, or no affinity requested
+    int scheduling = SCHEDULING_NORMAL; ///< Class in effect; lower than requested without the privilege
+};
+
+constexpr int HIGH_NICE = -10;        ///< Linux nice value of SCHEDULING_HIGH
+constexpr int REALTIME_PRIORITY = 10; ///< Linux SCHED_FIFO priority of SCHEDULING_REALTIME
+
+/**
+ * @brief Online cores, at most 64.
+ */
+auto coreCount() -> int;
+
+/**
+ * @brief Applies a placement to the calling thread, also undoing an earlier placement.
+ *
+ * Scheduling classes the process may not use fall back to the next lower class.
+ */
+auto applyThreadPlacement(const ThreadPlacement &placement) -> PlacementResult;
+
+/**
+ * @brief Cores left to the worker pool: the online cores not in detectionCores.
+ *
+ * @return 0 (all cores) if detectionCores is 0 or leaves no core over.
+ */
+auto workerCores(uint64_t detectionCores) -> uint64_t;
+
+/**
+ * @brief Parses a core list such as "2,3" or "0-1,6".
+ *
+ * @return The core mask, nullopt if the list is malformed or names a core above 63.
+ */
+auto parseCoreList(const std::string &list) -> std::optional<uint64_t>;
+
+/**
+ * @brief Formats a core mask as a core list, "all" for 0.
+ */
+auto formatCoreList(uint64_t cores) -> std::string;
+
+/**
+ * @brief Parses "normal", "high", "realtime" or the SchedulingClass value.
+ */
+auto parseScheduling(const std::string &name) -> std::optional<int>;
+
+auto schedulingName(int scheduling) -> const char *;
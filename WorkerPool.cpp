@@ -0,0 +1,314 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace
+{
+    // pool and index of the calling thread; a thread belongs to at most one pool
+    thread_local const WorkerPool *currentPool = nullptr;
+    thread_local int currentIndex = 0;
+}
+
+WorkerPool::WorkerPool(int threads, std::function<void()> threadInit)
+{
+    threads = std::max(threads, 1);
+    for (int i = 0; i < threads; i++)
+    {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 1; i < threads; i++)
+    {
+        workers.emplace_back([this, i, threadInit](std::stop_token stopToken)
+                             { worker(stopToken, i, threadInit); });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    // request_stop wakes the sleeping workers through their stop token
+    for (auto &w : workers)
+    {
+        w.request_stop();
+    }
+    workers.clear();
+}
+
+auto WorkerPool::threadIndex() const -> int
+{
+    return currentPool == this ? currentIndex : 0;
+}
+
+auto WorkerPool::submit(Job job, const std::atomic<int> &group) -> void
+{
+    auto &q = *queues[threadIndex()];
+    {
+        std::lock_guard lock(q.mutex);
+        q.jobs.push_back({std::move(job), &group});
+    }
+    ++queued;
+    // a sleeping waiter of another group would ignore the wake, so wake them all
+    notify();
+}
+
+auto WorkerPool::helpUntil(const std::atomic<int> &remaining) -> void
+{
+    const int index = threadIndex();
+    int spins = 0;
+    while (remaining > 0)
+    {
+        // only jobs of this wait: another group's job may be long or belong to another stage
+        if (auto job = take(index, &remaining))
+        {
+            job();
+            spins = 0;
+            continue;
+        }
+        if (++spins < SPIN_ROUNDS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock lock(mutex);
+        wake.wait(lock, [&]
+                  { return remaining == 0 || hasJob(&remaining); });
+        spins = 0;
+    }
+}
+
+auto WorkerPool::finish(std::atomic<int> &remaining) -> void
+{
+    if (--remaining == 0)
+    {
+        notify();
+    }
+}
+
+auto WorkerPool::parallelFor(int tasks, const std::function<void(int, int)> &body) -> void
+{
+    const int chunks = std::min(tasks, threads());
+    if (chunks <= 1)
+    {
+        if (tasks > 0)
+        {
+            body(0, tasks);
+        }
+        return;
+    }
+    std::atomic<int> remaining{chunks};
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto runChunk = [&](int c)
+    {
+        try
+        {
+            body(int(int64_t(tasks) * c / chunks), int(int64_t(tasks) * (c + 1) / chunks));
+        }
+        catch (...)
+        {
+            std::lock_guard lock(errorMutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+        finish(remaining);
+    };
+    for (int c = 1; c < chunks; c++)
+    {
+        submit([&runChunk, c]
+               { runChunk(c); },
+               remaining);
+    }
+    // the caller takes the first chunk and then helps with the rest
+    runChunk(0);
+    helpUntil(remaining);
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+auto WorkerPool::worker(std::stop_token stopToken, int index, const std::function<void()> &threadInit) -> void
+{
+    if (threadInit)
+    {
+        threadInit();
+    }
+    currentPool = this;
+    currentIndex = index;
+    int spins = 0;
+    while (!stopToken.stop_requested())
+    {
+        if (auto job = take(index))
+        {
+            job();
+            spins = 0;
+            continue;
+        }
+        if (++spins < SPIN_ROUNDS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock lock(mutex);
+        wake.wait(lock, stopToken, [this]
+                  { return queued > 0; });
+        spins = 0;
+    }
+}
+
+auto WorkerPool::take(int index, const std::atomic<int> *group) -> Job
+{
+    if (queued == 0)
+    {
+        return {};
+    }
+    auto matches = [group](const Entry &e)
+    { return !group || e.group == group; };
+    const int n = threads();
+    for (int k = 0; k < n; k++)
+    {
+        auto &q = *queues[(index + k) % n];
+        std::lock_guard lock(q.mutex);
+        std::deque<Entry>::iterator it;
+        if (k == 0 && index != 0)
+        {
+            // own deque: newest first, its data is still in this core's cache
+            auto r = std::find_if(q.jobs.rbegin(), q.jobs.rend(), matches);
+            it = r == q.jobs.rend() ? q.jobs.end() : std::prev(r.base());
+        }
+        else
+        {
+            it = std::find_if(q.jobs.begin(), q.jobs.end(), matches);
+        }
+        if (it == q.jobs.end())
+        {
+            continue;
+        }
+        Job job = std::move(it->job);
+        q.jobs.erase(it);
+        --queued;
+        return job;
+    }
+    return {};
+}
+
+auto WorkerPool::hasJob(const std::atomic<int> *group) -> bool
+{
+    for (auto &q : queues)
+    {
+        std::lock_guard lock(q->mutex);
+        if (std::any_of(q->jobs.begin(), q->jobs.end(), [group](const Entry &e)
+                        { return e.group == group; }))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto WorkerPool::notify() -> void
+{
+    {
+        // sleepers check their condition under this mutex, so the notify cannot be lost
+        std::lock_guard lock(mutex);
+    }
+    wake.notify_all();
+}
+
+auto setPoolParallelBackend(std::shared_ptr<WorkerPool> pool) -> void
+{
+    if (!pool)
+    {
+        // an empty backend makes OpenCV use its built-in one
+        cv::parallel::setParallelForBackend(std::shared_ptr<cv::parallel::ParallelForAPI>{});
+        return;
+    }
+    // the pool size is fixed; do not pass OpenCV's thread count on to it
+    cv::parallel::setParallelForBackend(std::make_shared<PoolParallelBackend>(std::move(pool)), false);
+}
+
+static auto processCpuMs() -> double
+{
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        return 0;
+    }
+    auto ms = [](const FILETIME &t)
+    { return ((uint64_t(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 10000.0; };
+    return ms(kernel) + ms(user);
+}
+
+auto checkParallelContention(std::string imgPath, std::string templatePath, const std::vector<int> &coreCounts, int stages, int iterations) -> void
+{
+    cv::Mat screen = cv::imread(imgPath);
+    cv::Mat templ = cv::imread(templatePath, cv::IMREAD_GRAYSCALE);
+    if (screen.empty() || templ.empty())
+    {
+        logError("checkParallelContention: could not read", imgPath, templatePath);
+        return;
+    }
+    // one stage iteration: the preprocess and match work of a frame
+    auto stageLoop = [&](std::vector<double> &times)
+    {
+        cv::Mat gray, scaled, result;
+        for (int k = 0; k < iterations; k++)
+        {
+            cv::TickMeter tm;
+            tm.start();
+            cv::cvtColor(screen, gray, cv::COLOR_BGR2GRAY);
+            cv::resize(gray, scaled, cv::Size(), 373.0 / gray.cols, 373.0 / gray.cols, cv::INTER_AREA);
+            cv::matchTemplate(scaled, templ, result, cv::TM_CCOEFF_NORMED);
+            tm.stop();
+            times.push_back(tm.getTimeMilli());
+        }
+    };
+    auto run = [&](const char *backend, int cores)
+    {
+        std::vector<std::vector<double>> times(stages);
+        const double cpuStart = processCpuMs();
+        cv::TickMeter wall;
+        wall.start();
+        {
+            std::vector<std::jthread> threads;
+            for (int s = 0; s < stages; s++)
+            {
+                threads.emplace_back([&, s]
+                                     { stageLoop(times[s]); });
+            }
+        }
+        wall.stop();
+        double sum = 0, worst = 0;
+        size_t n = 0;
+        for (const auto &t : times)
+        {
+            for (double ms : t)
+            {
+                sum += ms;
+                worst = std::max(worst, ms);
+                ++n;
+            }
+        }
+        logInfo("checkParallelContention", backend, "cores", cores, "stages", stages, ":", n ? sum / n : 0.0, "ms/iteration, worst",
+                worst, "ms, wall", wall.getTimeMilli(), "ms, cpu", processCpuMs() - cpuStart, "ms");
+    };
+
+    const int hostCores = cv::getNumberOfCPUs();
+    for (int cores : coreCounts)
+    {
+        if (cores > hostCores)
+        {
+            logInfo("checkParallelContention: host has", hostCores, "cores,", cores, "is oversubscribed");
+        }
+        setPoolParallelBackend(nullptr);
+        cv::setNumThreads(cores);
+        run("opencv", cores);
+        setPoolParallelBackend(std::make_shared<WorkerPool>(cores));
+        run("pool", cores);
+    }
+    // back to OpenCV's default pool
+    setPoolParallelBackend(nullptr);
+    cv::setNumThreads(-1);
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include "utils.h"
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/parallel/parallel_backend.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed pool of work-stealing threads shared by the task graph and OpenCV.
+ *
+ * Every pool thread owns a deque and takes its newest job first; threads outside the pool
+ * submit to a shared inbox. An idle thread steals the oldest job of the other deques, polls
+ * SPIN_ROUNDS times and then sleeps until a job is submitted, so an idle pool costs no CPU,
+ * unlike a pool that spins until its next region. Every job belongs to the group of the wait
+ * that submitted it. A thread that waits for its group runs queued jobs of that group meanwhile
+ * instead of blocking, so nested waits cannot starve the pool, and callers outside the pool,
+ * e.g. the pipeline stages sharing the inbox, never run each other's work.
+ */
+class WorkerPool
+{
+public:
+    using Job = std::function<void()>;
+
+    static constexpr int SPIN_ROUNDS = 64; ///< Empty polls of an idle thread before it sleeps
+
+    /**
+     * @param threads Threads working on jobs, a waiting caller counted as one.
+     * @param threadInit Run first on every pool thread, e.g. to set its affinity.
+     */
+    explicit WorkerPool(int threads, std::function<void()> threadInit = {});
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    auto threads() const -> int { return int(queues.size()); }
+
+    /**
+     * @brief Index of the calling thread: 1..threads()-1 for pool threads, 0 for any other thread.
+     */
+    auto threadIndex() const -> int;
+
+    /**
+     * @brief Queues a job of the wait on group.
+     *
+     * @param job The work.
+     * @param group Counter of the helpUntil wait the job belongs to.
+     */
+    auto submit(Job job, const std::atomic<int> &group) -> void;
+
+    /**
+     * @brief Runs queued jobs of the group remaining until it drops to 0.
+     */
+    auto helpUntil(const std::atomic<int> &remaining) -> void;
+
+    /**
+     * @brief Counts a job of a helpUntil wait as done and wakes the waiter on the last one.
+     */
+    auto finish(std::atomic<int> &remaining) -> void;
+
+    /**
+     * @brief Runs body over [0, tasks) in up to threads() contiguous chunks and waits for them.
+     *
+     * The first exception of a chunk is rethrown once all chunks are done.
+     */
+    auto parallelFor(int tasks, const std::function<void(int, int)> &body) -> void;
+
+private:
+    struct Entry
+    {
+        Job job;
+        const std::atomic<int> *group;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Entry> jobs;
+    };
+
+    auto worker(std::stop_token stopToken, int index, const std::function<void()> &threadInit) -> void;
+    /// own newest job first, then the oldest job of the other queues, of group only unless it
+    /// is nullptr; empty if there is none
+    auto take(int index, const std::atomic<int> *group = nullptr) -> Job;
+    auto hasJob(const std::atomic<int> *group) -> bool;
+    auto notify() -> void;
+
+    std::vector<std::unique_ptr<Queue>> queues; ///< 0 is the inbox of threads outside the pool
+    std::mutex mutex;
+    std::condition_variable_any wake;
+    std::atomic<int> queued{0};
+    std::vector<std::jthread> workers; ///< Last member: joined before the queues are destroyed
+};
+
+/**
+ * @brief OpenCV parallel_for backend running on a WorkerPool.
+ *
+ * Installed with cv::parallel::setParallelForBackend, it makes cv::matchTemplate, cv::resize,
+ * cv::cvtColor and the rest of OpenCV share the pool threads with the task graph instead of
+ * starting a second pool of the same size. The pool size is fixed, so setNumThreads is ignored.
+ */
+class PoolParallelBackend : public cv::parallel::ParallelForAPI
+{
+public:
+    explicit PoolParallelBackend(std::shared_ptr<WorkerPool> pool) : pool{std::move(pool)} {}
+
+    auto parallel_for(int tasks, FN_parallel_for_body_cb_t body, void *data) -> void override
+    {
+        pool->parallelFor(tasks, [&](int start, int end)
+                          { body(start, end, data); });
+    }
+    auto getThreadNum() const -> int override { return pool->threadIndex(); }
+    auto getNumThreads() const -> int override { return pool->threads(); }
+    auto setNumThreads(int) -> int override { return pool->threads(); }
+    auto getName() const -> const char * override { return "worker-pool"; }
+
+private:
+    std::shared_ptr<WorkerPool> pool;
+};
+
+/**
+ * @brief Installs a PoolParallelBackend on the pool, or OpenCV's built-in backend again for nullptr.
+ */
+auto setPoolParallelBackend(std::shared_ptr<WorkerPool> pool) -> void;
+
+/**
+ * @brief Bench: OpenCV's own pool against PoolParallelBackend under contention.
+ *
+ * For every core count, `stages` threads run cvtColor, resize and matchTemplate on the frame
+ * at the same time, like the pipeline stages and the matcher do, first on OpenCV's default
+ * backend limited to that many threads and then on a WorkerPool of that size. Logs the mean
+ * and worst time per iteration and the process CPU time of both. Core counts above the
+ * host's are still run, oversubscribed, and marked as such.
+ *
+ * @param imgPath A screen frame.
+ * @param templatePath Path of the up-arrow template.
+ * @param coreCounts Pool sizes to compare.
+ * @param stages Threads calling OpenCV concurrently.
+ * @param iterations Iterations per stage thread.
+ */
+auto checkParallelContention(std::string imgPath, std::string templatePath, const std::vector<int> &coreCounts = {4, 8, 16}, int stages = 3, int iterations = 200) -> void;
@@ -1,26 +1,1702 @@
 #include "utils.h"
 #include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <bit>
+#include <filesystem>
+#include <map>
+#include <mutex>
 #include "cv_utils.h"
 #ifdef HAVE_OPENCV_OCL
 #include <opencv2/core/ocl.hpp>
 #endif 
+#include <immintrin.h>
+
+// Lets GCC/Clang emit the dispatched SIMD kernels without global -m flags; MSVC needs none.
+#if defined(_MSC_VER)
+#define DR_TARGET(isa)
+#else
+#define DR_TARGET(isa) __attribute__((target(isa)))
+#endif
+
 auto matchTemplateInRegion(const cv::Mat &img, const cv::Mat &templ, cv::Rect region,int method) -> cv::Mat
 {
-    // Adjust the region if it exceeds the image boundaries
-    region.x = std::max(region.x, 0);
-    region.y = std::max(region.y, 0);
-    region.width = std::min(region.width, img.cols - region.x);
-    region.height = std::min(region.height, img.rows - region.y);
+    // Adjust the region if it exceeds the image boundaries
+    region.x = std::max(region.x, 0);
+    region.y = std::max(region.y, 0);
+    region.width = std::min(region.width, img.cols - region.x);
+    region.height = std::min(region.height, img.rows - region.y);
+
+    // Extract the region of interest (ROI) from the image
+    cv::Mat img_region = img(region);
+
+
+    // Match the template in the ROI
+    cv::Mat result;
+    cv::matchTemplate(img_region, templ, result, method); 
+    return result;
+}
+
+// picks the strongest gradient opaque pixels, spread to one per 2x2 cell before doubling up
+static auto selectSamplePoints(TemplateRotation &rot, int maxPoints) -> void
+{
+    cv::Mat gx, gy, mag;
+    cv::Sobel(rot.gray, gx, CV_32F, 1, 0);
+    cv::Sobel(rot.gray, gy, CV_32F, 0, 1);
+    cv::magnitude(gx, gy, mag);
+    struct Candidate
+    {
+        float strength;
+        cv::Point p;
+    };
+    std::vector<Candidate> candidates;
+    for (int y = 0; y < rot.gray.rows; ++y)
+    {
+        for (int x = 0; x < rot.gray.cols; ++x)
+        {
+            if (rot.mask.empty() || rot.mask.at<uchar>(y, x) >= 128)
+            {
+                candidates.push_back({mag.at<float>(y, x), {x, y}});
+            }
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+                     { return a.strength > b.strength; });
+    std::vector<char> used(candidates.size(), 0);
+    cv::Mat taken = cv::Mat::zeros(rot.gray.rows / 2 + 1, rot.gray.cols / 2 + 1, CV_8U);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (size_t i = 0; i < candidates.size() && int(rot.samples.size()) < maxPoints; ++i)
+        {
+            auto p = candidates[i].p;
+            uchar &cell = taken.at<uchar>(p.y / 2, p.x / 2);
+            if (used[i] || (pass == 0 && cell))
+            {
+                continue;
+            }
+            used[i] = 1;
+            cell = 1;
+            rot.samples.push_back(p);
+        }
+    }
+    // raster order keeps the image reads of a window moving forward
+    std::sort(rot.samples.begin(), rot.samples.end(), [](const cv::Point &a, const cv::Point &b)
+              { return a.y != b.y ? a.y < b.y : a.x < b.x; });
+    double mean = 0;
+    for (const auto &p : rot.samples)
+    {
+        mean += rot.gray.at<uchar>(p);
+    }
+    mean /= std::max<size_t>(rot.samples.size(), 1);
+    double norm = 0;
+    for (const auto &p : rot.samples)
+    {
+        float w = float(rot.gray.at<uchar>(p) - mean);
+        rot.sampleWeights.push_back(w);
+        norm += double(w) * w;
+    }
+    rot.sampleNorm = std::sqrt(norm);
+}
+
+// packs nonzero pixels into bits, pixel i at bit i % 64 of word i / 64
+static auto packRowBits(const uchar *src, int n, uint64_t *dst) -> void
+{
+    for (int i = 0; i < n; ++i)
+    {
+        dst[i >> 6] |= uint64_t(src[i] != 0) << (i & 63);
+    }
+}
+
+static auto prepareBits(TemplateRotation &rot) -> void
+{
+    cv::Mat bin;
+    cv::threshold(rot.gray, bin, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+    cv::Mat valid(rot.gray.size(), CV_8U, cv::Scalar(255));
+    if (!rot.mask.empty())
+    {
+        cv::threshold(rot.mask, valid, 127, 255, cv::THRESH_BINARY);
+    }
+    rot.bitWords = (rot.gray.cols + 63) / 64;
+    rot.bits.assign(size_t(rot.gray.rows) * rot.bitWords, 0);
+    rot.bitMask.assign(rot.bits.size(), 0);
+    for (int y = 0; y < rot.gray.rows; ++y)
+    {
+        packRowBits(bin.ptr<uchar>(y), bin.cols, &rot.bits[size_t(y) * rot.bitWords]);
+        packRowBits(valid.ptr<uchar>(y), valid.cols, &rot.bitMask[size_t(y) * rot.bitWords]);
+    }
+    rot.bitCount = 0;
+    rot.bitOnes = 0;
+    for (size_t i = 0; i < rot.bits.size(); ++i)
+    {
+        rot.bitCount += std::popcount(rot.bitMask[i]);
+        rot.bitOnes += std::popcount(rot.bits[i] & rot.bitMask[i]);
+    }
+}
+
+auto prepareRotation(const cv::Mat &gray, const cv::Mat &mask) -> TemplateRotation
+{
+    TemplateRotation rot;
+    rot.gray = gray;
+    rot.mask = mask;
+    for (int i = 0; i < gray.rows; ++i)
+    {
+        const uchar *t = gray.ptr<uchar>(i);
+        for (int j = 0; j < gray.cols; ++j)
+        {
+            rot.sum += t[j];
+            rot.sqSum += t[j] * t[j];
+        }
+    }
+    const double area = double(gray.total());
+    rot.mean = rot.sum / area;
+    rot.norm = std::sqrt(std::max(rot.sqSum - rot.sum * rot.mean, 0.0));
+    gray.convertTo(rot.zeroMean, CV_32F, 1.0, -rot.mean);
+    // zero padded rows keep every row of the widened copy on a 64-byte boundary
+    rot.widened.create(gray.rows, int(cv::alignSize(gray.cols, 32)), CV_16S);
+    rot.widened.setTo(cv::Scalar(0));
+    gray.convertTo(rot.widened(cv::Rect{0, 0, gray.cols, gray.rows}), CV_16S);
+    selectSamplePoints(rot, SPARSE_SAMPLE_POINTS);
+    prepareBits(rot);
+    return rot;
+}
+
+PreparedTemplate::PreparedTemplate(const cv::Mat &upTemplate)
+{
+    cv::Mat up, mask;
+    if (upTemplate.channels() == 1)
+    {
+        up = upTemplate.clone();
+    }
+    else
+    {
+        cv::cvtColor(upTemplate, up, cv::COLOR_BGR2GRAY);
+    }
+    if (upTemplate.channels() == 4)
+    {
+        cv::extractChannel(upTemplate, mask, 3);
+    }
+    auto rotated = [](const cv::Mat &src, int code)
+    {
+        cv::Mat dst;
+        if (!src.empty())
+        {
+            cv::rotate(src, dst, code);
+        }
+        return dst;
+    };
+    rotations[LANE_LEFT] = prepareRotation(rotated(up, cv::ROTATE_90_COUNTERCLOCKWISE), rotated(mask, cv::ROTATE_90_COUNTERCLOCKWISE));
+    rotations[LANE_DOWN] = prepareRotation(rotated(up, cv::ROTATE_180), rotated(mask, cv::ROTATE_180));
+    rotations[LANE_UP] = prepareRotation(up, mask);
+    rotations[LANE_RIGHT] = prepareRotation(rotated(up, cv::ROTATE_90_CLOCKWISE), rotated(mask, cv::ROTATE_90_CLOCKWISE));
+}
+
+auto PreparedTemplate::resized(double fx, double fy) const -> PreparedTemplate
+{
+    PreparedTemplate out;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        cv::Mat small, smallMask;
+        cv::resize(rotations[i].gray, small, cv::Size(), fx, fy, cv::INTER_AREA);
+        if (!rotations[i].mask.empty())
+        {
+            cv::resize(rotations[i].mask, smallMask, small.size(), 0, 0, cv::INTER_AREA);
+        }
+        out.rotations[i] = prepareRotation(small, smallMask);
+    }
+    return out;
+}
+
+auto PreparedTemplate::prepareSpectra(cv::Size dftSize) -> void
+{
+    for (auto &rot : rotations)
+    {
+        if (rot.spectrumSize == dftSize || rot.gray.empty())
+        {
+            continue;
+        }
+        cv::Mat padded(dftSize, CV_32F, cv::Scalar(0));
+        rot.zeroMean.copyTo(padded(cv::Rect{0, 0, rot.gray.cols, rot.gray.rows}));
+        cv::dft(padded, rot.spectrum, 0, rot.gray.rows);
+        rot.spectrumSize = dftSize;
+    }
+}
+
+auto computeFrameStats(const cv::Mat &gray) -> FrameStats
+{
+    FrameStats stats;
+    cv::integral(gray, stats.sum, stats.sqsum, CV_32S, CV_64F);
+    return stats;
+}
+
+auto splitLanes(cv::Size frameSize) -> std::array<cv::Rect, LANE_COUNT>
+{
+    double whx = frameSize.width / 4.0;
+    int wh0 = int(whx);
+    std::array<cv::Rect, LANE_COUNT> regions;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        int x = int(whx * i);
+        regions[i] = {x, 0, std::min(wh0, frameSize.width - x), frameSize.height};
+    }
+    return regions;
+}
+
+// Turns a TM_CCORR map of region into TM_CCOEFF_NORMED using the shared frame integrals.
+// Mirrors the normalization of cv::matchTemplate, including its handling of flat windows.
+static auto normalizeCcorr(cv::Mat &result, const FrameStats &stats, cv::Point origin, cv::Size templSize, double templMean, double templNorm) -> void
+{
+    const double invArea = 1.0 / templSize.area();
+    for (int y = 0; y < result.rows; ++y)
+    {
+        const int *s0 = stats.sum.ptr<int>(origin.y + y) + origin.x;
+        const int *s1 = stats.sum.ptr<int>(origin.y + y + templSize.height) + origin.x;
+        const double *q0 = stats.sqsum.ptr<double>(origin.y + y) + origin.x;
+        const double *q1 = stats.sqsum.ptr<double>(origin.y + y + templSize.height) + origin.x;
+        float *row = result.ptr<float>(y);
+        for (int x = 0; x < result.cols; ++x)
+        {
+            const int w = templSize.width;
+            double wndSum = double(s1[x + w] - s1[x] - s0[x + w] + s0[x]);
+            double wndSum2 = q1[x + w] - q1[x] - q0[x + w] + q0[x];
+            double num = row[x] - wndSum * templMean;
+            double t = std::sqrt(std::max(wndSum2 - wndSum * wndSum * invArea, 0.0)) * templNorm;
+            if (std::abs(num) < t)
+                num /= t;
+            else if (std::abs(num) < t * 1.125)
+                num = num > 0 ? 1 : -1;
+            else
+                num = 0;
+            row[x] = float(num);
+        }
+    }
+}
+
+auto matchTemplateInRegion(const cv::Mat &img, const TemplateRotation &templ, cv::Rect region) -> cv::Mat
+{
+    cv::Mat result;
+    region &= cv::Rect{0, 0, img.cols, img.rows};
+    if (region.width < templ.gray.cols || region.height < templ.gray.rows)
+    {
+        return result;
+    }
+    cv::Mat imgRegion = img(region);
+    auto stats = computeFrameStats(imgRegion);
+    cv::matchTemplate(imgRegion, templ.gray, result, cv::TM_CCORR);
+    normalizeCcorr(result, stats, {0, 0}, templ.size(), templ.mean, templ.norm);
+    return result;
+}
+
+// TM_CCOEFF_NORMED of one region from an 8-bit TM_CCORR and the shared frame integrals
+static auto matchCcorrInRegion(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, cv::Rect region) -> cv::Mat
+{
+    cv::Mat result;
+    region &= cv::Rect{0, 0, gray.cols, gray.rows};
+    if (region.width < templ.gray.cols || region.height < templ.gray.rows)
+    {
+        return result;
+    }
+    // TM_CCORR keeps the 8-bit path; the mean terms are removed with the integrals
+    cv::matchTemplate(gray(region), templ.gray, result, cv::TM_CCORR);
+    normalizeCcorr(result, stats, region.tl(), templ.size(), templ.mean, templ.norm);
+    return result;
+}
+
+auto matchLanes(const cv::Mat &gray, const PreparedTemplate &templ, const std::array<cv::Rect, LANE_COUNT> &regions) -> std::array<cv::Mat, LANE_COUNT>
+{
+    std::array<cv::Mat, LANE_COUNT> results;
+    // one pass over the frame for the image-side statistics of all lanes
+    auto stats = computeFrameStats(gray);
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        results[i] = matchCcorrInRegion(gray, stats, templ[i], regions[i]);
+    }
+    return results;
+}
+
+auto detectSimdLevel() -> SimdLevel
+{
+    // cv::checkHardwareSupport also verifies the OS saves the wide registers
+    static const SimdLevel level = []
+    {
+        if (cv::checkHardwareSupport(CV_CPU_AVX_512BW))
+            return SIMD_AVX512;
+        if (cv::checkHardwareSupport(CV_CPU_AVX2))
+            return SIMD_AVX2;
+        if (cv::checkHardwareSupport(CV_CPU_SSE4_2))
+            return SIMD_SSE42;
+        return SIMD_SCALAR;
+    }();
+    return level;
+}
+
+auto simdLevelName(SimdLevel level) -> const char *
+{
+    switch (level)
+    {
+    case SIMD_SSE42:
+        return "SSE4.2";
+    case SIMD_AVX2:
+        return "AVX2";
+    case SIMD_AVX512:
+        return "AVX-512";
+    default:
+        return "Scalar";
+    }
+}
+
+// Computes the integer dot products of the template with `count` consecutive windows.
+// img points to the top-left pixel of the first window, templ is the template widened to
+// 16 bits with rows of tStride elements. 8-bit x 8-bit products of a template up to
+// MAX_DOT_AREA pixels fit in int32.
+static constexpr int64_t MAX_DOT_AREA = INT32_MAX / (255 * 255);
+
+typedef void (*WindowDotFn)(const uchar *img, size_t step, const short *templ, int tStride, cv::Size tSize, int count, int *out);
+
+static void windowDotScalar(const uchar *img, size_t step, const short *templ, int tStride, cv::Size tSize, int count, int *out)
+{
+    for (int x = 0; x < count; ++x)
+    {
+        int acc = 0;
+        for (int i = 0; i < tSize.height; ++i)
+        {
+            const uchar *r = img + i * step + x;
+            const short *t = templ + i * tStride;
+            for (int j = 0; j < tSize.width; ++j)
+                acc += r[j] * t[j];
+        }
+        out[x] = acc;
+    }
+}
+
+DR_TARGET("sse4.2")
+static void windowDotSse42(const uchar *img, size_t step, const short *templ, int tStride, cv::Size tSize, int count, int *out)
+{
+    const int vecW = tSize.width & ~15;
+    for (int x = 0; x < count; ++x)
+    {
+        __m128i acc = _mm_setzero_si128();
+        int tail = 0;
+        for (int i = 0; i < tSize.height; ++i)
+        {
+            const uchar *r = img + i * step + x;
+            const short *t = templ + i * tStride;
+            int j = 0;
+            for (; j < vecW; j += 16)
+            {
+                __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r + j));
+                __m128i lo = _mm_cvtepu8_epi16(p);
+                __m128i hi = _mm_cvtepu8_epi16(_mm_srli_si128(p, 8));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + j))));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, _mm_loadu_si128(reinterpret_cast<const __m128i *>(t + j + 8))));
+            }
+            for (; j < tSize.width; ++j)
+                tail += r[j] * t[j];
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[x] = _mm_cvtsi128_si32(acc) + tail;
+    }
+}
+
+DR_TARGET("avx2")
+static void windowDotAvx2(const uchar *img, size_t step, const short *templ, int tStride, cv::Size tSize, int count, int *out)
+{
+    const int vecW = tSize.width & ~15;
+    for (int x = 0; x < count; ++x)
+    {
+        __m256i acc = _mm256_setzero_si256();
+        int tail = 0;
+        for (int i = 0; i < tSize.height; ++i)
+        {
+            const uchar *r = img + i * step + x;
+            const short *t = templ + i * tStride;
+            int j = 0;
+            for (; j < vecW; j += 16)
+            {
+                __m256i p = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r + j)));
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(p, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(t + j))));
+            }
+            for (; j < tSize.width; ++j)
+                tail += r[j] * t[j];
+        }
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+        out[x] = _mm_cvtsi128_si32(s) + tail;
+    }
+}
+
+DR_TARGET("avx512f,avx512bw")
+static void windowDotAvx512(const uchar *img, size_t step, const short *templ, int tStride, cv::Size tSize, int count, int *out)
+{
+    const int vecW = tSize.width & ~31;
+    for (int x = 0; x < count; ++x)
+    {
+        __m512i acc = _mm512_setzero_si512();
+        int tail = 0;
+        for (int i = 0; i < tSize.height; ++i)
+        {
+            const uchar *r = img + i * step + x;
+            const short *t = templ + i * tStride;
+            int j = 0;
+            for (; j < vecW; j += 32)
+            {
+                __m512i p = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(r + j)));
+                acc = _mm512_add_epi32(acc, _mm512_madd_epi16(p, _mm512_loadu_si512(t + j)));
+            }
+            for (; j < tSize.width; ++j)
+                tail += r[j] * t[j];
+        }
+        out[x] = _mm512_reduce_add_epi32(acc) + tail;
+    }
+}
+
+static auto selectWindowDot() -> WindowDotFn
+{
+    static const WindowDotFn fn = []
+    {
+        auto level = detectSimdLevel();
+        logInfo("NCC kernel:", simdLevelName(level));
+        switch (level)
+        {
+        case SIMD_AVX512:
+            return &windowDotAvx512;
+        case SIMD_AVX2:
+            return &windowDotAvx2;
+        case SIMD_SSE42:
+            return &windowDotSse42;
+        default:
+            return &windowDotScalar;
+        }
+    }();
+    return fn;
+}
+
+// scores a row of windows at the precomputed sample offsets
+typedef void (*SparseRowFn)(const uchar *base, const int *offsets, const float *weights, int n, double templNorm, int width, float *out);
+
+static inline float sparseScore(double dot, int sum, int sqSum, int n, double templNorm)
+{
+    double var = sqSum - double(sum) * sum / n;
+    double denom = templNorm * std::sqrt(std::max(var, 0.0));
+    return denom > 1e-6 ? float(dot / denom) : 0.f;
+}
+
+static void sparseRowScalar(const uchar *base, const int *offsets, const float *weights, int n, double templNorm, int width, float *out)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        float dot = 0;
+        int sum = 0, sqSum = 0;
+        for (int k = 0; k < n; ++k)
+        {
+            int v = base[x + offsets[k]];
+            dot += weights[k] * v;
+            sum += v;
+            sqSum += v * v;
+        }
+        out[x] = sparseScore(dot, sum, sqSum, n, templNorm);
+    }
+}
+
+DR_TARGET("avx2")
+static void sparseRowAvx2(const uchar *base, const int *offsets, const float *weights, int n, double templNorm, int width, float *out)
+{
+    int x = 0;
+    // 8 neighbouring windows read 8 consecutive pixels at every sample offset
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256 dot = _mm256_setzero_ps();
+        __m256i sum = _mm256_setzero_si256();
+        __m256i sqSum = _mm256_setzero_si256();
+        for (int k = 0; k < n; ++k)
+        {
+            __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(base + x + offsets[k])));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_cvtepi32_ps(v)));
+            sum = _mm256_add_epi32(sum, v);
+            sqSum = _mm256_add_epi32(sqSum, _mm256_mullo_epi32(v, v));
+        }
+        alignas(32) float dots[8];
+        alignas(32) int sums[8], sqSums[8];
+        _mm256_store_ps(dots, dot);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(sums), sum);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(sqSums), sqSum);
+        for (int j = 0; j < 8; ++j)
+        {
+            out[x + j] = sparseScore(dots[j], sums[j], sqSums[j], n, templNorm);
+        }
+    }
+    if (x < width)
+    {
+        sparseRowScalar(base + x, offsets, weights, n, templNorm, width - x, out + x);
+    }
+}
+
+static auto selectSparseRow() -> SparseRowFn
+{
+    static const SparseRowFn fn = detectSimdLevel() >= SIMD_AVX2 ? &sparseRowAvx2 : &sparseRowScalar;
+    return fn;
+}
+
+auto matchSparseInRegion(const cv::Mat &img, const TemplateRotation &templ, cv::Rect region) -> cv::Mat
+{
+    cv::Mat result;
+    region &= cv::Rect{0, 0, img.cols, img.rows};
+    const cv::Size tSize = templ.size();
+    if (region.width < tSize.width || region.height < tSize.height)
+    {
+        return result;
+    }
+    const int resW = region.width - tSize.width + 1;
+    const int resH = region.height - tSize.height + 1;
+    result.create(resH, resW, CV_32F);
+    const int n = int(templ.samples.size());
+    if (n == 0)
+    {
+        result.setTo(cv::Scalar(0));
+        return result;
+    }
+    std::vector<int> offsets(n);
+    for (int k = 0; k < n; ++k)
+    {
+        offsets[k] = templ.samples[k].y * int(img.step) + templ.samples[k].x;
+    }
+    auto sparseRow = selectSparseRow();
+    for (int y = 0; y < resH; ++y)
+    {
+        sparseRow(img.ptr<uchar>(region.y + y) + region.x, offsets.data(), templ.sampleWeights.data(), n, templ.sampleNorm, resW, result.ptr<float>(y));
+    }
+    return result;
+}
+
+// 64 bits of a packed row starting at any bit; rows carry one spare word for the high half
+static inline uint64_t windowBits(const uint64_t *row, int bit)
+{
+    const int word = bit >> 6;
+    const int shift = bit & 63;
+    return shift ? (row[word] >> shift) | (row[word + 1] << (64 - shift)) : row[word];
+}
+
+// phi coefficient of the template and a window from their set bits under the mask:
+// n compared bits, a set in the template, b set in the window, c set in both
+static inline float phiScore(int64_t n, int64_t a, int64_t b, int64_t c)
+{
+    const double den2 = double(a * (n - a)) * double(b * (n - b));
+    // a flat window or template correlates with nothing
+    return den2 > 0 ? float(double(n * c - a * b) / std::sqrt(den2)) : 0.0f;
+}
+
+// scores one result row; rows points at the packed strip row of the window top
+typedef void (*BinaryRowFn)(const uint64_t *rows, int rowWords, const TemplateRotation &templ, int width, float *out);
+
+static void binaryRowScalar(const uint64_t *rows, int rowWords, const TemplateRotation &templ, int width, float *out)
+{
+    const int th = templ.gray.rows;
+    const int tw = templ.bitWords;
+    for (int x = 0; x < width; ++x)
+    {
+        int ones = 0, both = 0;
+        for (int r = 0; r < th; ++r)
+        {
+            const uint64_t *row = rows + size_t(r) * rowWords;
+            const uint64_t *t = &templ.bits[size_t(r) * tw];
+            const uint64_t *m = &templ.bitMask[size_t(r) * tw];
+            for (int w = 0; w < tw; ++w)
+            {
+                const uint64_t wnd = windowBits(row, x + 64 * w) & m[w];
+                ones += std::popcount(wnd);
+                both += std::popcount(wnd & t[w]);
+            }
+        }
+        out[x] = phiScore(templ.bitCount, templ.bitOnes, ones, both);
+    }
+}
+
+DR_TARGET("popcnt")
+static void binaryRowPopcnt(const uint64_t *rows, int rowWords, const TemplateRotation &templ, int width, float *out)
+{
+    const int th = templ.gray.rows;
+    const int tw = templ.bitWords;
+    for (int x = 0; x < width; ++x)
+    {
+        int64_t ones = 0, both = 0;
+        for (int r = 0; r < th; ++r)
+        {
+            const uint64_t *row = rows + size_t(r) * rowWords;
+            const uint64_t *t = &templ.bits[size_t(r) * tw];
+            const uint64_t *m = &templ.bitMask[size_t(r) * tw];
+            for (int w = 0; w < tw; ++w)
+            {
+                const uint64_t wnd = windowBits(row, x + 64 * w) & m[w];
+                ones += _mm_popcnt_u64(wnd);
+                both += _mm_popcnt_u64(wnd & t[w]);
+            }
+        }
+        out[x] = phiScore(templ.bitCount, templ.bitOnes, ones, both);
+    }
+}
+
+static auto selectBinaryRow() -> BinaryRowFn
+{
+    // every SSE4.2 capable CPU also has POPCNT
+    static const BinaryRowFn fn = detectSimdLevel() >= SIMD_SSE42 ? &binaryRowPopcnt : &binaryRowScalar;
+    return fn;
+}
+
+auto matchBinaryInRegion(const cv::Mat &img, const TemplateRotation &templ, cv::Rect region) -> cv::Mat
+{
+    cv::Mat result;
+    region &= cv::Rect{0, 0, img.cols, img.rows};
+    const cv::Size tSize = templ.size();
+    if (region.width < tSize.width || region.height < tSize.height || templ.bits.empty())
+    {
+        return result;
+    }
+    const int resW = region.width - tSize.width + 1;
+    const int resH = region.height - tSize.height + 1;
+    cv::Mat bin;
+    cv::threshold(img(region), bin, 0, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+    const int rowWords = (region.width + 63) / 64 + 1;
+    std::vector<uint64_t> packed(size_t(region.height) * rowWords, 0);
+    for (int y = 0; y < region.height; ++y)
+    {
+        packRowBits(bin.ptr<uchar>(y), region.width, &packed[size_t(y) * rowWords]);
+    }
+    result.create(resH, resW, CV_32F);
+    auto binaryRow = selectBinaryRow();
+    for (int y = 0; y < resH; ++y)
+    {
+        binaryRow(&packed[size_t(y) * rowWords], rowWords, templ, resW, result.ptr<float>(y));
+    }
+    return result;
+}
+
+auto matchPeaksInRegion(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, cv::Rect region, float threshold) -> std::vector<MatchPeak>
+{
+    std::vector<MatchPeak> peaks;
+    const cv::Size tSize = templ.size();
+    region &= cv::Rect{0, 0, gray.cols, gray.rows};
+    if (region.width < tSize.width || region.height < tSize.height)
+    {
+        return peaks;
+    }
+    const int resW = region.width - tSize.width + 1;
+    const int resH = region.height - tSize.height + 1;
+    const int64_t n = tSize.area();
+    const int64_t tSum = templ.sum;
+    // n^2 * variance of the template
+    const double tVarN = double(n * templ.sqSum - tSum * tSum);
+    if (tVarN <= 0)
+    {
+        return peaks;
+    }
+    if (n > MAX_DOT_AREA)
+    {
+        // e.g. native resolution templates: the int32 dot products would overflow
+        cv::Mat result = matchCcorrInRegion(gray, stats, templ, region);
+        for (int y = 0; y < result.rows; ++y)
+        {
+            const float *row = result.ptr<float>(y);
+            for (int x = 0; x < result.cols; ++x)
+            {
+                if (row[x] >= threshold)
+                {
+                    peaks.push_back({y, x, std::min(row[x], 1.0f)});
+                }
+            }
+        }
+        return peaks;
+    }
+    const double thr2 = double(threshold) * threshold;
+    auto windowDot = selectWindowDot();
+    std::vector<int> dots(resW);
+    for (int y = 0; y < resH; ++y)
+    {
+        windowDot(gray.ptr<uchar>(region.y + y) + region.x, gray.step, templ.widened.ptr<short>(), templ.widened.cols, tSize, resW, dots.data());
+        const int *s0 = stats.sum.ptr<int>(region.y + y) + region.x;
+        const int *s1 = stats.sum.ptr<int>(region.y + y + tSize.height) + region.x;
+        const double *q0 = stats.sqsum.ptr<double>(region.y + y) + region.x;
+        const double *q1 = stats.sqsum.ptr<double>(region.y + y + tSize.height) + region.x;
+        for (int x = 0; x < resW; ++x)
+        {
+            const int w = tSize.width;
+            int64_t wndSum = s1[x + w] - s1[x] - s0[x + w] + s0[x];
+            int64_t wndSqSum = int64_t(q1[x + w] - q1[x] - q0[x + w] + q0[x]);
+            // everything scaled by n so it stays in exact integers until the final ratio
+            int64_t num = n * dots[x] - wndSum * tSum;
+            if (num <= 0)
+            {
+                continue;
+            }
+            double iVarN = double(n * wndSqSum - wndSum * wndSum);
+            double den2 = iVarN * tVarN;
+            if (den2 <= 0 || double(num) * double(num) < thr2 * den2)
+            {
+                continue;
+            }
+            peaks.push_back({y, x, float(std::min(double(num) / std::sqrt(den2), 1.0))});
+        }
+    }
+    return peaks;
+}
+
+auto matchLanePeaks(const cv::Mat &gray, const PreparedTemplate &templ, const std::array<cv::Rect, LANE_COUNT> &regions, float threshold) -> std::array<std::vector<MatchPeak>, LANE_COUNT>
+{
+    std::array<std::vector<MatchPeak>, LANE_COUNT> peaks;
+    auto stats = computeFrameStats(gray);
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        peaks[i] = matchPeaksInRegion(gray, stats, templ[i], regions[i], threshold);
+    }
+    return peaks;
+}
+
+typedef float (*RowMaxFn)(const float *row, int cols);
+
+static float rowMaxScalar(const float *row, int cols)
+{
+    float m = -FLT_MAX;
+    for (int x = 0; x < cols; ++x)
+        m = std::max(m, row[x]);
+    return m;
+}
+
+DR_TARGET("sse4.2")
+static float rowMaxSse42(const float *row, int cols)
+{
+    __m128 m = _mm_set1_ps(-FLT_MAX);
+    int x = 0;
+    for (; x + 4 <= cols; x += 4)
+        m = _mm_max_ps(m, _mm_loadu_ps(row + x));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+    float r = _mm_cvtss_f32(m);
+    for (; x < cols; ++x)
+        r = std::max(r, row[x]);
+    return r;
+}
+
+DR_TARGET("avx2")
+static float rowMaxAvx2(const float *row, int cols)
+{
+    __m256 m = _mm256_set1_ps(-FLT_MAX);
+    int x = 0;
+    for (; x + 8 <= cols; x += 8)
+        m = _mm256_max_ps(m, _mm256_loadu_ps(row + x));
+    __m128 h = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+    h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+    h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+    float r = _mm_cvtss_f32(h);
+    for (; x < cols; ++x)
+        r = std::max(r, row[x]);
+    return r;
+}
+
+static auto selectRowMax() -> RowMaxFn
+{
+    static const RowMaxFn fn = []
+    {
+        switch (detectSimdLevel())
+        {
+        case SIMD_AVX512:
+        case SIMD_AVX2:
+            return &rowMaxAvx2;
+        case SIMD_SSE42:
+            return &rowMaxSse42;
+        default:
+            return &rowMaxScalar;
+        }
+    }();
+    return fn;
+}
+
+auto rowMaxima(const cv::Mat &result, int rows) -> std::vector<float>
+{
+    rows = std::min(rows, result.rows);
+    std::vector<float> maxima(std::max(rows, 0));
+    auto rowMax = selectRowMax();
+    for (int y = 0; y < rows; ++y)
+    {
+        maxima[y] = rowMax(result.ptr<float>(y), result.cols);
+    }
+    return maxima;
+}
+
+using RowSumFn = int (*)(const uchar *, int);
+
+static int rowSumScalar(const uchar *row, int cols)
+{
+    int r = 0;
+    for (int x = 0; x < cols; ++x)
+        r += row[x];
+    return r;
+}
+
+// _mm_sad_epu8 against zero adds 8 bytes into each 64-bit lane
+DR_TARGET("sse4.2")
+static int rowSumSse42(const uchar *row, int cols)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i s = zero;
+    int x = 0;
+    for (; x + 16 <= cols; x += 16)
+        s = _mm_add_epi64(s, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x)), zero));
+    int r = _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+    for (; x < cols; ++x)
+        r += row[x];
+    return r;
+}
+
+DR_TARGET("avx2")
+static int rowSumAvx2(const uchar *row, int cols)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i s = zero;
+    int x = 0;
+    for (; x + 32 <= cols; x += 32)
+        s = _mm256_add_epi64(s, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x)), zero));
+    __m128i h = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    int r = _mm_cvtsi128_si32(h) + _mm_extract_epi32(h, 2);
+    for (; x < cols; ++x)
+        r += row[x];
+    return r;
+}
+
+static auto selectRowSum() -> RowSumFn
+{
+    static const RowSumFn fn = []
+    {
+        switch (detectSimdLevel())
+        {
+        case SIMD_AVX512:
+        case SIMD_AVX2:
+            return &rowSumAvx2;
+        case SIMD_SSE42:
+            return &rowSumSse42;
+        default:
+            return &rowSumScalar;
+        }
+    }();
+    return fn;
+}
+
+auto rowSums(const cv::Mat &img) -> std::vector<int>
+{
+    std::vector<int> sums(img.rows);
+    auto rowSum = selectRowSum();
+    for (int y = 0; y < img.rows; ++y)
+    {
+        sums[y] = rowSum(img.ptr<uchar>(y), img.cols);
+    }
+    return sums;
+}
+
+auto suppressRowMaxima(const std::vector<float> &maxima, int height, float threshold) -> std::vector<int>
+{
+    std::vector<int> locations;
+    constexpr int dispY = LOCATION_DISP_Y;
+    locations.reserve(50);
+    float last_thresh = 0;
+    int lastY = 0;
+    for (int y = 0; y < int(maxima.size()); ++y)
+    {
+        auto thresh = maxima[y];
+        if (thresh < threshold)
+        {
+            continue;
+        }
+        // within a row only the maximum can win, so one value per row is enough
+        if (std::abs(y - lastY) > dispY)
+        {
+            locations.emplace_back(y + height);
+            lastY = y;
+            last_thresh = thresh;
+        }
+        else if (thresh > last_thresh)
+        {
+            if (locations.size() > 0)
+            {
+                locations.back() = y + height;
+            }
+            else
+            {
+                locations.emplace_back(y + height);
+            }
+            lastY = y;
+            last_thresh = thresh;
+        }
+    }
+    return locations;
+}
+
+auto getLocationsBottomY(const cv::Mat &result, int height, int exitArea, float threshold) -> std::vector<int>
+{
+    // rows below the exit line never produce a location
+    return suppressRowMaxima(rowMaxima(result, exitArea + 1), height, threshold);
+}
+
+auto getLocationsBottomYReference(const cv::Mat &result, int height, int exitArea, float threshold) -> std::vector<int>
+{
+    std::vector<int> locations;
+    constexpr int dispY = LOCATION_DISP_Y;
+    locations.reserve(50);
+    float last_thresh = 0;
+    int lastY = 0; 
+    for (int y = 0; y < result.rows; ++y)
+    {
+        for (int x = 0; x < result.cols; ++x)
+        {
+            auto thresh = result.at<float>(y, x);
+            if (thresh >= threshold)
+            {
+                // do not match
+                if(y>exitArea) {
+                    continue;
+                }
+                if (std::abs(y - lastY) > dispY)
+                {
+                    locations.emplace_back(y + height);
+                    lastY = y;
+                    last_thresh = thresh;
+                }
+                else
+                {
+                    if (thresh > last_thresh)
+                    {  
+
+                        if(locations.size()>0){
+                            locations.back() = y + height;
+                        }else{
+                            locations.emplace_back(y + height);
+                        }
+                        lastY = y;
+                        last_thresh = thresh;
+                    }
+                }
+            }
+        }
+    }
+    return locations;
+}
+
+auto suppressDetections(const std::vector<Detection> &detections, int dispY) -> std::vector<Detection>
+{
+    std::vector<Detection> kept;
+    kept.reserve(50);
+    for (const auto &detection : detections)
+    {
+        if (kept.empty() || std::abs(detection.y - kept.back().y) > dispY)
+        {
+            kept.push_back(detection);
+        }
+        else if (detection.score > kept.back().score)
+        {
+            // the stronger match wins the neighbourhood
+            kept.back() = detection;
+        }
+    }
+    return kept;
+}
+
+auto getLocationDetections(const std::vector<MatchPeak> &peaks, int height, int exitArea, int dispY) -> std::vector<Detection>
+{
+    std::vector<Detection> candidates;
+    candidates.reserve(peaks.size());
+    for (const auto &peak : peaks)
+    {
+        if (peak.y > exitArea)
+        {
+            break;
+        }
+        candidates.push_back({peak.y + height, peak.x, peak.score});
+    }
+    return suppressDetections(candidates, dispY);
+}
+
+auto getLocationsBottomY(const std::vector<MatchPeak> &peaks, int height, int exitArea) -> std::vector<int>
+{
+    auto detections = getLocationDetections(peaks, height, exitArea);
+    std::vector<int> locations;
+    locations.reserve(detections.size());
+    for (const auto &detection : detections)
+    {
+        locations.push_back(detection.y);
+    }
+    return locations;
+}
+
+auto checkLocationsBottomY(int iterations) -> bool
+{
+    cv::RNG rng(0x5eed);
+    for (int i = 0; i < iterations; i++)
+    {
+        cv::Mat result(rng.uniform(1, 480), rng.uniform(1, 40), CV_32F);
+        cv::randu(result, cv::Scalar(-0.3), cv::Scalar(0.5));
+        // sprinkle arrow-like high score blobs
+        int blobs = rng.uniform(0, 8);
+        for (int b = 0; b < blobs; b++)
+        {
+            cv::Rect blob{rng.uniform(0, result.cols), rng.uniform(0, result.rows), rng.uniform(1, 6), rng.uniform(1, 12)};
+            blob &= cv::Rect{0, 0, result.cols, result.rows};
+            cv::Mat roi = result(blob);
+            cv::randu(roi, cv::Scalar(0.4), cv::Scalar(1.0));
+        }
+        int height = rng.uniform(0, 70);
+        int exitArea = rng.uniform(-5, result.rows + 5);
+        float threshold = float(rng.uniform(0.3, 0.8));
+        auto expected = getLocationsBottomYReference(result, height, exitArea, threshold);
+        auto fromRows = getLocationsBottomY(result, height, exitArea, threshold);
+        auto fromPeaks = getLocationsBottomY(rowPeaksFromResult(result, threshold), height, exitArea);
+        if (fromRows != expected || fromPeaks != expected)
+        {
+            logError("checkLocationsBottomY mismatch at iteration", i, "size", result.cols, "x", result.rows,
+                     "expected", expected.size(), "rows", fromRows.size(), "peaks", fromPeaks.size());
+            return false;
+        }
+    }
+    logInfo("checkLocationsBottomY passed", iterations, "iterations");
+    return true;
+}
+
+auto rowPeaksFromResult(const cv::Mat &result, float threshold) -> std::vector<MatchPeak>
+{
+    std::vector<MatchPeak> peaks;
+    auto rowMax = selectRowMax();
+    for (int y = 0; y < result.rows; ++y)
+    {
+        const float *row = result.ptr<float>(y);
+        float m = rowMax(row, result.cols);
+        if (m >= threshold)
+        {
+            // only rows that pass pay for the argmax
+            int x = int(std::find(row, row + result.cols, m) - row);
+            peaks.push_back({y, x, m});
+        }
+    }
+    return peaks;
+}
+
+auto matchEngineName(MatchEngine engine) -> const char *
+{
+    switch (engine)
+    {
+    case MATCH_ENGINE_OPENCV:
+        return "OpenCV";
+    case MATCH_ENGINE_SPATIAL:
+        return "Spatial";
+    case MATCH_ENGINE_FFT:
+        return "FFT";
+    case MATCH_ENGINE_SPARSE:
+        return "Sparse";
+    case MATCH_ENGINE_BINARY:
+        return "Binary";
+    case MATCH_ENGINE_BLOB:
+        return "Blob";
+    default:
+        return "Auto";
+    }
+}
+
+static auto optimalDftSize(cv::Size stripSize) -> cv::Size
+{
+    // circular correlation is exact for every valid window once the DFT covers the strip
+    return {cv::getOptimalDFTSize(stripSize.width), cv::getOptimalDFTSize(stripSize.height)};
+}
+
+auto matchFftInRegion(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, cv::Rect region, FftPlan &plan) -> cv::Mat
+{
+    const cv::Size tSize = templ.size();
+    region &= cv::Rect{0, 0, gray.cols, gray.rows};
+    if (region.width < tSize.width || region.height < tSize.height)
+    {
+        return {};
+    }
+    if (plan.stripSize != region.size())
+    {
+        plan.stripSize = region.size();
+        plan.dftSize = optimalDftSize(region.size());
+        plan.padded.create(plan.dftSize, CV_32F);
+        plan.padded.setTo(cv::Scalar(0));
+        plan.templSpectrum.release();
+    }
+    if (templ.spectrumSize == plan.dftSize)
+    {
+        plan.templSpectrum = templ.spectrum;
+    }
+    else if (plan.templSpectrum.empty())
+    {
+        cv::Mat paddedTempl(plan.dftSize, CV_32F, cv::Scalar(0));
+        templ.zeroMean.copyTo(paddedTempl(cv::Rect{{0, 0}, tSize}));
+        cv::dft(paddedTempl, plan.templSpectrum, 0, tSize.height);
+    }
+    const int resW = region.width - tSize.width + 1;
+    const int resH = region.height - tSize.height + 1;
+    // only the strip area is rewritten; the zero padding stays from plan creation
+    gray(region).convertTo(plan.padded(cv::Rect{{0, 0}, region.size()}), CV_32F);
+    cv::dft(plan.padded, plan.spectrum, 0, region.height);
+    cv::mulSpectrums(plan.spectrum, plan.templSpectrum, plan.spectrum, 0, true);
+    cv::dft(plan.spectrum, plan.corr, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, resH);
+    cv::Mat result = plan.corr(cv::Rect{0, 0, resW, resH});
+    // correlating with the zero-mean template already removed the mean term
+    normalizeCcorr(result, stats, region.tl(), tSize, 0.0, templ.norm);
+    return result;
+}
+
+auto calibrateMatchCost(const TemplateRotation &templ) -> MatchCostModel
+{
+    MatchCostModel cost;
+    const cv::Size tSize = templ.size();
+    // a production sized lane strip: a quarter of 373 px wide
+    cv::Mat strip(std::max(480, tSize.height * 2), std::max(96, tSize.width + 8), CV_8U);
+    cv::randu(strip, cv::Scalar(0), cv::Scalar(256));
+    cv::Rect region{0, 0, strip.cols, strip.rows};
+    auto stats = computeFrameStats(strip);
+    FftPlan plan;
+    constexpr int REPEAT = 5;
+    double spatialMs = 1e9, fftMs = 1e9;
+    for (int i = 0; i < REPEAT; i++)
+    {
+        cv::TickMeter tm;
+        tm.start();
+        // a threshold above 1 keeps the output empty so only the kernel is measured
+        matchPeaksInRegion(strip, stats, templ, region, 2.0f);
+        tm.stop();
+        spatialMs = std::min(spatialMs, tm.getTimeMilli());
+        tm.reset();
+        tm.start();
+        matchFftInRegion(strip, stats, templ, region, plan);
+        tm.stop();
+        fftMs = std::min(fftMs, tm.getTimeMilli());
+    }
+    double macs = double(strip.cols - tSize.width + 1) * (strip.rows - tSize.height + 1) * tSize.area();
+    double points = double(plan.dftSize.area());
+    cost.spatialPerMac = spatialMs * 1e6 / macs;
+    cost.fftPerPoint = fftMs * 1e6 / (points * std::log2(points));
+    logInfo("Match calibration: spatial", spatialMs, "ms fft", fftMs, "ms strip", strip.cols, "x", strip.rows);
+    return cost;
+}
+
+auto chooseMatchEngine(const MatchCostModel &cost, cv::Size stripSize, cv::Size templSize) -> MatchEngine
+{
+    if (cost.spatialPerMac <= 0 || cost.fftPerPoint <= 0)
+    {
+        return MATCH_ENGINE_SPATIAL;
+    }
+    double macs = double(stripSize.width - templSize.width + 1) * (stripSize.height - templSize.height + 1) * templSize.area();
+    double points = double(optimalDftSize(stripSize).area());
+    double spatial = cost.spatialPerMac * macs;
+    double fft = cost.fftPerPoint * points * std::log2(points);
+    return fft < spatial ? MATCH_ENGINE_FFT : MATCH_ENGINE_SPATIAL;
+}
+
+auto BlobDetector::detectLane(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, int lane, cv::Rect laneRegion, cv::Rect search, float threshold) -> std::vector<MatchPeak>
+{
+    std::vector<MatchPeak> peaks;
+    laneRegion &= cv::Rect{0, 0, gray.cols, gray.rows};
+    search &= laneRegion;
+    if (laneRegion.empty())
+    {
+        return peaks;
+    }
+    cv::Mat strip = gray(laneRegion);
+    auto &bg = background[lane];
+    if (lanes[lane] != laneRegion || bg.size() != strip.size())
+    {
+        // new or moved lane: seed the background with it
+        strip.convertTo(bg, CV_32F);
+        lanes[lane] = laneRegion;
+        frames[lane] = 0;
+    }
+    cv::Mat bg8, diff, fg;
+    bg.convertTo(bg8, CV_8U);
+    cv::absdiff(strip, bg8, diff);
+    cv::threshold(diff, fg, DIFF_THRESHOLD, 255, cv::THRESH_BINARY);
+
+    const cv::Size tSize = templ.size();
+    if (search.width >= tSize.width && search.height >= tSize.height)
+    {
+        findBlobs(gray, stats, templ, fg(search - laneRegion.tl()), search, frames[lane] >= WARMUP_FRAMES, threshold, peaks);
+    }
+
+    // foreground pixels learn slowly so lasting scene changes still fade into the background
+    cv::Mat still;
+    cv::bitwise_not(fg, still);
+    // each pixel blends once, at the rate of its mask
+    cv::accumulateWeighted(strip, bg, LEARNING_RATE / 10, fg);
+    cv::accumulateWeighted(strip, bg, LEARNING_RATE, still);
+    frames[lane]++;
+
+    std::sort(peaks.begin(), peaks.end(), [](const MatchPeak &a, const MatchPeak &b)
+              { return a.y != b.y ? a.y < b.y : a.x < b.x; });
+    return peaks;
+}
+
+auto BlobDetector::findBlobs(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, const cv::Mat &fg, cv::Rect region, bool warm, float threshold, std::vector<MatchPeak> &peaks) -> void
+{
+    const cv::Size tSize = templ.size();
+    cv::Mat labels, blobStats, centroids;
+    int n = cv::connectedComponentsWithStats(fg, labels, blobStats, centroids, 8, CV_32S);
+
+    const int resW = region.width - tSize.width + 1;
+    const int resH = region.height - tSize.height + 1;
+    auto near = [](int size, int templSize)
+    { return size * 10 >= templSize * 7 && size * 10 <= templSize * 13; };
+    for (int c = 1; c < n; c++)
+    {
+        cv::Rect box{blobStats.at<int>(c, cv::CC_STAT_LEFT), blobStats.at<int>(c, cv::CC_STAT_TOP),
+                     blobStats.at<int>(c, cv::CC_STAT_WIDTH), blobStats.at<int>(c, cv::CC_STAT_HEIGHT)};
+        if (blobStats.at<int>(c, cv::CC_STAT_AREA) * 8 < tSize.area())
+        {
+            continue;
+        }
+        if (warm && near(box.width, tSize.width) && near(box.height, tSize.height))
+        {
+            // bottom aligned: exit timing only depends on the bottom of the arrow
+            int y = std::clamp(box.y + box.height - tSize.height, 0, resH - 1);
+            int x = std::clamp(box.x + (box.width - tSize.width) / 2, 0, resW - 1);
+            peaks.push_back({y, x, 1.0f});
+            continue;
+        }
+        // merged, partial or noisy blob: confirm with the template around it
+        cv::Rect around = cv::Rect{box.x - tSize.width, box.y - tSize.height, box.width + 2 * tSize.width, box.height + 2 * tSize.height} &
+                          cv::Rect{0, 0, region.width, region.height};
+        cv::Rect search{region.x + around.x, region.y + around.y, around.width, around.height};
+        for (auto p : matchPeaksInRegion(gray, stats, templ, search, threshold))
+        {
+            p.x += around.x;
+            p.y += around.y;
+            peaks.push_back(p);
+        }
+    }
+}
+
+LaneMatcher::LaneMatcher(const cv::Mat &upTemplate) : templ{upTemplate}
+{
+}
+
+// runs fn(lane) for every lane on the OpenCV thread pool; lanes only share read-only state.
+// times, if given, receives the time of every lane in ms
+template <typename Fn>
+static auto forEachLane(Fn &&fn, std::array<double, LANE_COUNT> *times = nullptr) -> void
+{
+    cv::parallel_for_(cv::Range(0, LANE_COUNT), [&](const cv::Range &range)
+                      {
+                          for (int i = range.start; i < range.end; i++)
+                          {
+                              const int64 start = cv::getTickCount();
+                              fn(i);
+                              if (times)
+                              {
+                                  (*times)[i] = double(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+                              }
+                          } });
+}
+
+auto LaneMatcher::calibrate() -> void
+{
+    // the benchmark stalls the calling thread: run it once per template size and process,
+    // not for every batch detector or every re-prepare
+    static std::mutex mutex;
+    static std::map<std::pair<int, int>, MatchCostModel> calibrated;
+    const cv::Size tSize = templ[LANE_UP].size();
+    {
+        std::lock_guard lock(mutex);
+        auto [it, added] = calibrated.try_emplace({tSize.width, tSize.height});
+        if (added)
+        {
+            it->second = calibrateMatchCost(templ[LANE_UP]);
+        }
+        cost = it->second;
+    }
+    laneSizes.fill({});
+}
+
+auto LaneMatcher::setEngine(MatchEngine engine) -> void
+{
+    this->engine = engine;
+    laneSizes.fill({});
+    blobs.reset();
+    if (engine == MATCH_ENGINE_BLOB)
+    {
+        logInfo("Blob engine: predicted windows are matched with the spatial NCC kernel");
+    }
+}
+
+auto LaneMatcher::setAnisotropic(int xFactor) -> void
+{
+    if ((xFactor > 1 ? xFactor : 0) == anisoFactor)
+    {
+        return;
+    }
+    if (anisoFactor > 1)
+    {
+        templ = std::move(uniformTempl);
+        uniformTempl = {};
+    }
+    anisoFactor = xFactor > 1 ? xFactor : 0;
+    if (anisoFactor)
+    {
+        uniformTempl = templ;
+        templ = uniformTempl.resized(1.0 / xFactor, 1.0);
+        logInfo("Anisotropic matching at 1 /", xFactor, "in x, template", templ[LANE_UP].gray.cols, "x", templ[LANE_UP].gray.rows);
+    }
+    // engines, spectra and backgrounds belong to the old templates
+    laneSizes.fill({});
+    blobs.reset();
+    if (pyramidFactor > 1)
+    {
+        setPyramid(pyramidFactor, pyramidThreshold);
+    }
+}
+
+auto LaneMatcher::setPyramid(int factor, float relaxedThreshold) -> void
+{
+    if (factor != 2 && factor != 4)
+    {
+        if (factor > 1)
+        {
+            logError("Unsupported pyramid factor", factor, "- matching at full resolution");
+        }
+        pyramidFactor = 0;
+        coarseTempl = {};
+        return;
+    }
+    pyramidFactor = factor;
+    pyramidThreshold = relaxedThreshold;
+    // resized after rotation, so it follows an x reduction of templ as well
+    coarseTempl = templ.resized(1.0 / factor, 1.0 / factor);
+    logInfo("Pyramid matching at 1 /", factor, "relaxed threshold", relaxedThreshold);
+}
+
+auto LaneMatcher::matchLanePyramid(const cv::Mat &gray, const FrameStats &stats, const cv::Mat &coarse, const FrameStats &coarseStats, int lane, cv::Rect region, float threshold) -> std::vector<MatchPeak>
+{
+    const int f = pyramidFactor;
+    const cv::Size tSize = templ[lane].size();
+    std::vector<MatchPeak> peaks;
+    if (region.width < tSize.width || region.height < tSize.height)
+    {
+        return peaks;
+    }
+    cv::Rect coarseRegion{region.x / f, region.y / f, region.width / f, region.height / f};
+    auto candidates = matchPeaksInRegion(coarse, coarseStats, coarseTempl[lane], coarseRegion, pyramidThreshold);
 
-    // Extract the region of interest (ROI) from the image
-    cv::Mat img_region = img(region);
+    // a coarse window covers f full resolution positions; search a little wider for rounding
+    const int radius = 2 * f;
+    const int resW = region.width - tSize.width + 1;
+    const int resH = region.height - tSize.height + 1;
+    // merge candidate neighbourhoods into disjoint row bands so refined peaks stay raster ordered
+    std::vector<cv::Rect> bands;
+    for (const auto &c : candidates)
+    {
+        int x0 = std::max(c.x * f - radius, 0);
+        int x1 = std::min(c.x * f + radius, resW - 1);
+        int y0 = std::max(c.y * f - radius, 0);
+        int y1 = std::min(c.y * f + radius, resH - 1);
+        if (x0 > x1 || y0 > y1)
+        {
+            continue;
+        }
+        if (!bands.empty() && y0 <= bands.back().y + bands.back().height)
+        {
+            auto &b = bands.back();
+            int bx1 = std::max(b.x + b.width - 1, x1);
+            int by1 = std::max(b.y + b.height - 1, y1);
+            b.x = std::min(b.x, x0);
+            b.width = bx1 - b.x + 1;
+            b.height = by1 - b.y + 1;
+        }
+        else
+        {
+            bands.push_back({x0, y0, x1 - x0 + 1, y1 - y0 + 1});
+        }
+    }
+    for (const auto &b : bands)
+    {
+        // band holds window positions; the searched area also spans the template
+        cv::Rect sub{region.x + b.x, region.y + b.y, b.width + tSize.width - 1, b.height + tSize.height - 1};
+        for (auto p : matchPeaksInRegion(gray, stats, templ[lane], sub, threshold))
+        {
+            p.x += b.x;
+            p.y += b.y;
+            peaks.push_back(p);
+        }
+    }
+    return peaks;
+}
 
+auto LaneMatcher::matchPeaks(const cv::Mat &gray, const std::array<cv::Rect, LANE_COUNT> &regions, float threshold, const std::array<cv::Rect, LANE_COUNT> *lanes) -> std::array<std::vector<MatchPeak>, LANE_COUNT>
+{
+    std::array<std::vector<MatchPeak>, LANE_COUNT> peaks;
+    auto stats = computeFrameStats(gray);
+    if (pyramidFactor > 1)
+    {
+        cv::Mat coarse;
+        cv::resize(gray, coarse, cv::Size(), 1.0 / pyramidFactor, 1.0 / pyramidFactor, cv::INTER_AREA);
+        auto coarseStats = computeFrameStats(coarse);
+        forEachLane([&](int i)
+                    {
+            cv::Rect region = regions[i] & cv::Rect{0, 0, gray.cols, gray.rows};
+            peaks[i] = matchLanePyramid(gray, stats, coarse, coarseStats, i, region, threshold); },
+                    &laneMs);
+        return peaks;
+    }
+    // engine choice first: preparing spectra touches the template shared by all lanes
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        cv::Rect region = regions[i] & cv::Rect{0, 0, gray.cols, gray.rows};
+        if (region.size() != laneSizes[i])
+        {
+            // capture size changed: pick the engine again for the new strip
+            laneSizes[i] = region.size();
+            laneEngines[i] = engine == MATCH_ENGINE_AUTO ? chooseMatchEngine(cost, region.size(), templ[i].size()) : engine;
+            if (laneEngines[i] == MATCH_ENGINE_FFT)
+            {
+                templ.prepareSpectra(optimalDftSize(region.size()));
+            }
+            logInfo("Lane", i, "strip", region.width, "x", region.height, "engine:", matchEngineName(laneEngines[i]));
+        }
+    }
+    // lanes only write their own plan, blob background and peaks
+    forEachLane([&](int i)
+                {
+        cv::Rect region = regions[i] & cv::Rect{0, 0, gray.cols, gray.rows};
+        switch (laneEngines[i])
+        {
+        case MATCH_ENGINE_FFT:
+            peaks[i] = rowPeaksFromResult(matchFftInRegion(gray, stats, templ[i], region, plans[i]), threshold);
+            break;
+        case MATCH_ENGINE_OPENCV:
+            peaks[i] = rowPeaksFromResult(matchCcorrInRegion(gray, stats, templ[i], region), threshold);
+            break;
+        case MATCH_ENGINE_SPARSE:
+            peaks[i] = rowPeaksFromResult(matchSparseInRegion(gray, templ[i], region), threshold);
+            break;
+        case MATCH_ENGINE_BINARY:
+            peaks[i] = rowPeaksFromResult(matchBinaryInRegion(gray, templ[i], region), threshold);
+            break;
+        case MATCH_ENGINE_BLOB:
+            peaks[i] = blobs.detectLane(gray, stats, templ[i], i, lanes ? (*lanes)[i] : region, region, threshold);
+            break;
+        default:
+            peaks[i] = matchPeaksInRegion(gray, stats, templ[i], region, threshold);
+            break;
+        } },
+                &laneMs);
+    return peaks;
+}
 
-    // Match the template in the ROI
-    cv::Mat result;
-    cv::matchTemplate(img_region, templ, result, method); 
-    return result;
+auto ColumnLock::observe(const std::vector<Detection> &detections, float confidentScore) -> void
+{
+    const bool wasLocked = locked();
+    bool confident = false;
+    for (const auto &d : detections)
+    {
+        if (d.score < confidentScore)
+        {
+            continue;
+        }
+        confident = true;
+        if (wasLocked || d.x < 0)
+        {
+            // confident but without a column to vote for
+            continue;
+        }
+        if (column >= 0 && std::abs(d.x - column) <= band)
+        {
+            ++votes;
+        }
+        else
+        {
+            // disagreeing column: start learning again from this one
+            column = d.x;
+            votes = 1;
+        }
+    }
+    if (!wasLocked)
+    {
+        if (locked())
+        {
+            logInfo("Column locked at", column);
+        }
+        return;
+    }
+    emptyFrames = detections.empty() ? emptyFrames + 1 : 0;
+    if (confident)
+    {
+        weakFrames = 0;
+    }
+    else if (!detections.empty())
+    {
+        ++weakFrames;
+    }
+    if (weakFrames >= DEGRADED_FRAMES || emptyFrames >= EMPTY_FRAMES)
+    {
+        logInfo("Column lock at", column, "dropped, weak frames", weakFrames, "empty frames", emptyFrames);
+        reset();
+    }
+}
+
+auto ColumnLock::restrict(cv::Rect region, int templWidth) const -> cv::Rect
+{
+    if (!locked())
+    {
+        return region;
+    }
+    cv::Rect narrowed{region.x + column - band, region.y, templWidth + 2 * band, region.height};
+    return narrowed & region;
+}
+
+auto ScrollEstimator::estimate(const cv::Mat &gray, const std::vector<cv::Rect> &strips) -> std::optional<float>
+{
+    cv::Mat cross;
+    background.resize(strips.size());
+    previous.resize(strips.size());
+    for (size_t i = 0; i < strips.size(); i++)
+    {
+        const cv::Rect r = strips[i] & cv::Rect{0, 0, gray.cols, gray.rows};
+        if (r.height < 2 || r.width < 1)
+        {
+            previous[i].release();
+            continue;
+        }
+        const auto sums = rowSums(gray(r));
+        const int len = int(sums.size());
+        if (int(background[i].size()) != len)
+        {
+            background[i].assign(sums.begin(), sums.end());
+            previous[i].release();
+        }
+        // zero padding by maxShift keeps the circular correlation from wrapping into the search range
+        cv::Mat profile = cv::Mat::zeros(1, cv::getOptimalDFTSize(len + maxShift), CV_32F);
+        float *p = profile.ptr<float>(0);
+        for (int y = 0; y < len; y++)
+        {
+            // Hann window against the strip ends, applied to the moving part only
+            const float w = 0.5f - 0.5f * float(std::cos(2 * CV_PI * y / (len - 1)));
+            p[y] = (sums[y] - background[i][y]) * w;
+            background[i][y] += BACKGROUND_RATE * (sums[y] - background[i][y]);
+        }
+        cv::Mat spectrum;
+        cv::dft(profile, spectrum, cv::DFT_COMPLEX_OUTPUT);
+        if (!previous[i].empty() && previous[i].cols == spectrum.cols)
+        {
+            cv::Mat laneCross;
+            cv::mulSpectrums(spectrum, previous[i], laneCross, 0, true);
+            if (cross.empty())
+            {
+                cross = laneCross;
+            }
+            else if (cross.cols == laneCross.cols)
+            {
+                cv::add(cross, laneCross, cross);
+            }
+        }
+        previous[i] = spectrum;
+    }
+    lastResponse = 0;
+    if (cross.empty())
+    {
+        return std::nullopt;
+    }
+    // keep the phase only
+    auto *c = cross.ptr<cv::Vec2f>(0);
+    for (int k = 0; k < cross.cols; k++)
+    {
+        const float mag = std::hypot(c[k][0], c[k][1]);
+        c[k] = mag > 1e-6f ? cv::Vec2f{c[k][0] / mag, c[k][1] / mag} : cv::Vec2f{0, 0};
+    }
+    cv::Mat corr;
+    cv::idft(cross, corr, cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+    const int n = corr.cols;
+    const float *r = corr.ptr<float>(0);
+    auto at = [&](int shift) { return r[(shift + n) % n]; };
+    int best = 0;
+    for (int s = -maxShift; s <= maxShift; s++)
+    {
+        if (at(s) > at(best))
+        {
+            best = s;
+        }
+    }
+    lastResponse = at(best);
+    if (lastResponse < MIN_RESPONSE)
+    {
+        return std::nullopt;
+    }
+    // parabolic sub-pixel refinement
+    const float l = at(best - 1), m = at(best), rr = at(best + 1);
+    const float den = l - 2 * m + rr;
+    return float(best) + (std::abs(den) > 1e-6f ? 0.5f * (l - rr) / den : 0.0f);
+}
+
+// sorts, clamps to [0, rows) and merges overlapping or touching row ranges
+static auto mergeRowWindows(std::vector<cv::Range> windows, int rows) -> std::vector<cv::Range>
+{
+    std::sort(windows.begin(), windows.end(), [](const cv::Range &a, const cv::Range &b) { return a.start < b.start; });
+    std::vector<cv::Range> merged;
+    for (auto w : windows)
+    {
+        w.start = std::max(w.start, 0);
+        w.end = std::min(w.end, rows);
+        if (w.start >= w.end)
+        {
+            continue;
+        }
+        if (!merged.empty() && w.start <= merged.back().end)
+        {
+            merged.back().end = std::max(merged.back().end, w.end);
+        }
+        else
+        {
+            merged.push_back(w);
+        }
+    }
+    return merged;
+}
+
+auto LaneMatcher::matchPeaksInWindows(const cv::Mat &gray, const std::array<cv::Rect, LANE_COUNT> &regions, const std::array<std::vector<cv::Range>, LANE_COUNT> &windows, float threshold) const -> std::array<std::vector<MatchPeak>, LANE_COUNT>
+{
+    return matchPeaksInWindows(gray, computeFrameStats(gray), regions, windows, threshold);
+}
+
+auto LaneMatcher::matchPeaksInWindows(const cv::Mat &gray, const FrameStats &stats, const std::array<cv::Rect, LANE_COUNT> &regions, const std::array<std::vector<cv::Range>, LANE_COUNT> &windows, float threshold) const -> std::array<std::vector<MatchPeak>, LANE_COUNT>
+{
+    std::array<std::vector<MatchPeak>, LANE_COUNT> peaks;
+    forEachLane([&](int i)
+                {
+        cv::Rect region = regions[i] & cv::Rect{0, 0, gray.cols, gray.rows};
+        const cv::Size tSize = templ[i].size();
+        if (region.width < tSize.width || region.height < tSize.height)
+        {
+            return;
+        }
+        for (const auto &w : mergeRowWindows(windows[i], region.height - tSize.height + 1))
+        {
+            // window holds match rows; the searched area also spans the template
+            cv::Rect sub{region.x, region.y + w.start, region.width, w.size() + tSize.height - 1};
+            std::vector<MatchPeak> found;
+            switch (engine)
+            {
+            case MATCH_ENGINE_SPARSE:
+                found = rowPeaksFromResult(matchSparseInRegion(gray, templ[i], sub), threshold);
+                break;
+            case MATCH_ENGINE_BINARY:
+                found = rowPeaksFromResult(matchBinaryInRegion(gray, templ[i], sub), threshold);
+                break;
+            default:
+                found = matchPeaksInRegion(gray, stats, templ[i], sub, threshold);
+                break;
+            }
+            for (auto p : found)
+            {
+                p.y += w.start;
+                peaks[i].push_back(p);
+            }
+        } },
+                &laneMs);
+    return peaks;
 }
+
 auto detectLines(const cv::Mat &img, int minLineLength) -> std::vector<cv::Vec4i>
 {
     cv::Mat edges = preprocessImageForEdges(img);
@@ -226,10 +1902,50 @@ auto LoadMatFromResource(HINSTANCE hInstance, LPCSTR resourceName, LPCSTR resour
     return mat;
 }
 
+auto loadTemplateVariants(const std::string &dir) -> std::vector<cv::Mat>
+{
+    std::vector<cv::Mat> variants;
+    std::error_code ec;
+    if (!std::filesystem::is_directory(dir, ec))
+    {
+        return variants;
+    }
+    std::vector<std::filesystem::path> paths;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        if (entry.path().extension() == ".png")
+        {
+            paths.push_back(entry.path());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    for (const auto &path : paths)
+    {
+        cv::Mat variant = cv::imread(path.string(), cv::IMREAD_UNCHANGED);
+        if (variant.empty())
+        {
+            logError("Could not read template variant", path.string());
+            continue;
+        }
+        logInfo("Template variant", variants.size() + 1, path.string());
+        variants.push_back(variant);
+    }
+    return variants;
+}
+
 
 
 auto checkOpenCvPerf(std::string imgPath, std::string templatePath ) -> void
 { 
+    cv::Mat m = cv::imread(imgPath);
+    cv::Mat tmp = cv::imread(templatePath);
+    int wh0 = int(m.cols / 4.0);
+    cv::Rect tmpRgn = {0, 0, std::min(tmp.cols, wh0  ), tmp.rows}; 
+    checkOpenCvPerf(imgPath, PreparedTemplate{tmp(tmpRgn)});
+}
+
+auto checkOpenCvPerf(std::string imgPath, const PreparedTemplate &templ) -> void
+{
     auto numThreads = cv::getNumThreads();
     auto setThreads = (numThreads+1)/2; 
     #ifdef HAVE_OPENCV_OCL
@@ -240,51 +1956,314 @@ auto checkOpenCvPerf(std::string imgPath, std::string templatePath ) -> void
 
 
     cv::Mat m = cv::imread(imgPath);
-    cv::Mat tmp = cv::imread(templatePath);
     cv::Mat grayScreen;
     cv::cvtColor(m, grayScreen, cv::COLOR_BGR2GRAY);
-    cv::Mat leftTemplate, rightTemplate, upTemplate, downTemplate;
 
     cv::setNumThreads(4);
     cv::Mat res, res1, res2, res3;
     LARGE_INTEGER frequency;
     LARGE_INTEGER start, end;
-    auto whx = grayScreen.cols / 4.0;
-    int wh0 = int(whx);
-    int wh1 = int(whx * 2);
-    int wh2 = int(whx * 3);
-    logInfo("wh0: ", wh0);
-    cv::Rect rgn = {0, 0, wh0, grayScreen.rows};
-    cv::Rect tmpRgn = {0, 0, std::min(tmp.cols, wh0  ), tmp.rows}; 
-    cv::cvtColor(tmp(tmpRgn), upTemplate, cv::COLOR_BGR2GRAY);
-    cv::rotate(upTemplate, leftTemplate, cv::ROTATE_90_COUNTERCLOCKWISE);
-    cv::rotate(upTemplate, rightTemplate, cv::ROTATE_90_CLOCKWISE);
-    cv::rotate(leftTemplate, downTemplate, cv::ROTATE_90_COUNTERCLOCKWISE);
+    auto laneRegions = splitLanes(grayScreen.size());
+    logInfo("wh0: ", laneRegions[LANE_LEFT].width);
     // Get the frequency of the performance counter
-    
+    QueryPerformanceFrequency(&frequency);
+    auto elapsedMs = [&]
+    { return static_cast<double>(end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart; };
+
+    // reference: OpenCV's own TM_CCOEFF_NORMED on the 8-bit lane strips
+    std::array<cv::Mat, LANE_COUNT> reference;
+    double referenceMs = 0, preparedMs = 0, lanesMs = 0;
+    for (int j = 0; j < 10; j++)
+    {
+        QueryPerformanceCounter(&start);
+        for (int i = 0; i < 100; i++)
+        {
+            for (int lane = 0; lane < LANE_COUNT; lane++)
+            {
+                cv::matchTemplate(grayScreen(laneRegions[lane]), templ[lane].gray, reference[lane], cv::TM_CCOEFF_NORMED);
+            }
+        }
+        QueryPerformanceCounter(&end);
+        referenceMs += elapsedMs() / 100.0;
+        logInfo("TM_CCOEFF_NORMED elapsed time: ", elapsedMs() / 100.0, "ms");
+    }
+
     for (int j = 0; j < 10; j++)
     {
         logInfo("Iteration: ", j);
-        QueryPerformanceFrequency(&frequency);
         // Record the starting time
         QueryPerformanceCounter(&start);
         for (int i = 0; i < 100; i++)
         {
-            res = matchTemplateInRegion(grayScreen, leftTemplate, rgn);
-            rgn.x = wh0;
-            res1 = matchTemplateInRegion(grayScreen, downTemplate, rgn);
-            rgn.x = wh1;
-            res2 = matchTemplateInRegion(grayScreen, upTemplate, rgn);
-            rgn.x = wh2;
-            res3 = matchTemplateInRegion(grayScreen, rightTemplate, rgn);
+            res = matchTemplateInRegion(grayScreen, templ[LANE_LEFT], laneRegions[LANE_LEFT]);
+            res1 = matchTemplateInRegion(grayScreen, templ[LANE_DOWN], laneRegions[LANE_DOWN]);
+            res2 = matchTemplateInRegion(grayScreen, templ[LANE_UP], laneRegions[LANE_UP]);
+            res3 = matchTemplateInRegion(grayScreen, templ[LANE_RIGHT], laneRegions[LANE_RIGHT]);
         }
 
         // Record the ending time
         QueryPerformanceCounter(&end);
 
         // Calculate elapsed time in milliseconds
-        double elapsedTime = static_cast<double>(end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
-        logInfo("Elapsed time: ", elapsedTime/100.0, "ms");
+        preparedMs += elapsedMs() / 100.0;
+        logInfo("Elapsed time: ", elapsedMs() / 100.0, "ms");
+    }
+    std::array<cv::Mat, LANE_COUNT> laneResults;
+    for (int j = 0; j < 10; j++)
+    {
+        QueryPerformanceCounter(&start);
+        for (int i = 0; i < 100; i++)
+        {
+            laneResults = matchLanes(grayScreen, templ, laneRegions);
+        }
+        QueryPerformanceCounter(&end);
+        lanesMs += elapsedMs() / 100.0;
+        logInfo("matchLanes elapsed time: ", elapsedMs() / 100.0, "ms");
     }
     logInfo("res: ", res.cols, "res1: ", res1.cols, "res2: ", res2.cols, "res3: ", res3.cols);
+
+    // agreement with the reference: the largest score difference of any window
+    const std::array<const cv::Mat *, LANE_COUNT> perLane{&res, &res1, &res2, &res3};
+    double perLaneDiff = 0, lanesDiff = 0;
+    for (int lane = 0; lane < LANE_COUNT; lane++)
+    {
+        if (reference[lane].size() == perLane[lane]->size())
+        {
+            perLaneDiff = std::max(perLaneDiff, cv::norm(reference[lane], *perLane[lane], cv::NORM_INF));
+        }
+        if (reference[lane].size() == laneResults[lane].size())
+        {
+            lanesDiff = std::max(lanesDiff, cv::norm(reference[lane], laneResults[lane], cv::NORM_INF));
+        }
+    }
+    logInfo("Mean TM_CCOEFF_NORMED:", referenceMs / 10, "ms, matchTemplateInRegion:", preparedMs / 10, "ms, speedup", referenceMs / std::max(preparedMs, 1e-9),
+            "max |diff|", perLaneDiff, "- matchLanes:", lanesMs / 10, "ms, speedup", referenceMs / std::max(lanesMs, 1e-9), "max |diff|", lanesDiff);
+}
+
+
+auto checkSimdNccPerf(std::string imgPath, std::string templatePath, float threshold) -> void
+{
+    cv::Mat m = cv::imread(imgPath);
+    cv::Mat tmp = cv::imread(templatePath);
+    if (m.empty() || tmp.empty())
+    {
+        logError("checkSimdNccPerf: could not read", imgPath, templatePath);
+        return;
+    }
+    cv::Mat grayScreen;
+    cv::cvtColor(m, grayScreen, cv::COLOR_BGR2GRAY);
+    PreparedTemplate templ{tmp};
+    // production scale: the frame is matched at 373 px width
+    double matchScale = 373.0 / grayScreen.cols;
+    cv::resize(grayScreen, grayScreen, cv::Size(), matchScale, matchScale, cv::INTER_NEAREST);
+    cv::Rect rgn = splitLanes(grayScreen.size())[LANE_UP];
+    logInfo("checkSimdNccPerf kernel:", simdLevelName(detectSimdLevel()), "frame:", grayScreen.cols, "x", grayScreen.rows, "lane width:", rgn.width);
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    auto elapsedMs = [&]
+    { return static_cast<double>(end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart; };
+    cv::Mat res;
+    std::vector<MatchPeak> peaks;
+    for (int j = 0; j < 10; j++)
+    {
+        QueryPerformanceCounter(&start);
+        for (int i = 0; i < 100; i++)
+        {
+            res = matchTemplateInRegion(grayScreen, templ[LANE_UP].gray, rgn);
+        }
+        QueryPerformanceCounter(&end);
+        double cvTime = elapsedMs() / 100.0;
+
+        QueryPerformanceCounter(&start);
+        for (int i = 0; i < 100; i++)
+        {
+            auto stats = computeFrameStats(grayScreen);
+            peaks = matchPeaksInRegion(grayScreen, stats, templ[LANE_UP], rgn, threshold);
+        }
+        QueryPerformanceCounter(&end);
+        logInfo("Iteration: ", j, "matchTemplateInRegion:", cvTime, "ms", "matchPeaksInRegion:", elapsedMs() / 100.0, "ms");
+    }
+    int above = 0;
+    for (int y = 0; y < res.rows; ++y)
+    {
+        for (int x = 0; x < res.cols; ++x)
+        {
+            above += res.at<float>(y, x) >= threshold;
+        }
+    }
+    logInfo("windows above threshold - matchTemplateInRegion:", above, "matchPeaksInRegion:", peaks.size());
+}
+
+auto checkAnisotropicAccuracy(std::string framesDir, std::string templatePath, const std::vector<int> &xFactors, float threshold) -> void
+{
+    cv::Mat tmp = cv::imread(templatePath);
+    if (tmp.empty())
+    {
+        logError("checkAnisotropicAccuracy: could not read", templatePath);
+        return;
+    }
+    std::vector<cv::Mat> frames;
+    for (const auto &entry : std::filesystem::directory_iterator(framesDir))
+    {
+        auto ext = entry.path().extension().string();
+        if (ext != ".png" && ext != ".jpg")
+        {
+            continue;
+        }
+        cv::Mat gray = cv::imread(entry.path().string(), cv::IMREAD_GRAYSCALE);
+        if (gray.empty())
+        {
+            continue;
+        }
+        // production scale: the frame is matched at 373 px width
+        if (gray.cols != 373)
+        {
+            double matchScale = 373.0 / gray.cols;
+            cv::resize(gray, gray, cv::Size(), matchScale, matchScale, cv::INTER_NEAREST);
+        }
+        frames.push_back(gray);
+    }
+    if (frames.empty())
+    {
+        logError("checkAnisotropicAccuracy: no frames in", framesDir);
+        return;
+    }
+
+    LaneMatcher matcher{tmp};
+    const int templHeight = matcher.templates()[LANE_UP].gray.rows;
+    auto detectAll = [&](const cv::Mat &gray)
+    {
+        auto peaks = matcher.matchPeaks(gray, splitLanes(gray.size()), threshold);
+        std::array<std::vector<Detection>, LANE_COUNT> detections;
+        for (int i = 0; i < LANE_COUNT; i++)
+        {
+            detections[i] = getLocationDetections(peaks[i], templHeight, gray.rows);
+        }
+        return detections;
+    };
+    auto timePerFrame = [&](const std::vector<cv::Mat> &input, std::vector<std::array<std::vector<Detection>, LANE_COUNT>> &out)
+    {
+        out.clear();
+        cv::TickMeter tm;
+        tm.start();
+        for (const auto &gray : input)
+        {
+            out.push_back(detectAll(gray));
+        }
+        tm.stop();
+        return tm.getTimeMilli() / frames.size();
+    };
+
+    matcher.setEngine(MATCH_ENGINE_SPATIAL);
+    std::vector<std::array<std::vector<Detection>, LANE_COUNT>> reference, reduced;
+    double fullMs = timePerFrame(frames, reference);
+    logInfo("checkAnisotropicAccuracy frames:", frames.size(), "full resolution:", fullMs, "ms/frame");
+    constexpr int MAX_DY = 2;
+    for (int f : xFactors)
+    {
+        matcher.setAnisotropic(f);
+        // like the preprocess stage, which folds the x reduction into its resize; not timed
+        std::vector<cv::Mat> narrow(frames.size());
+        for (size_t k = 0; k < frames.size(); k++)
+        {
+            cv::resize(frames[k], narrow[k], cv::Size(std::max(frames[k].cols / f, 1), frames[k].rows), 0, 0, cv::INTER_AREA);
+        }
+        double ms = timePerFrame(narrow, reduced);
+        int matched = 0, missed = 0, extra = 0;
+        double dySum = 0;
+        for (size_t k = 0; k < frames.size(); k++)
+        {
+            for (int i = 0; i < LANE_COUNT; i++)
+            {
+                const auto &want = reference[k][i];
+                const auto &got = reduced[k][i];
+                // every detection matches at most one expected peak
+                std::vector<bool> used(got.size(), false);
+                int hits = 0;
+                for (const auto &d : want)
+                {
+                    int best = -1;
+                    for (int g = 0; g < int(got.size()); g++)
+                    {
+                        if (!used[g] && std::abs(got[g].y - d.y) <= MAX_DY && (best < 0 || std::abs(got[g].y - d.y) < std::abs(got[best].y - d.y)))
+                        {
+                            best = g;
+                        }
+                    }
+                    if (best >= 0)
+                    {
+                        used[best] = true;
+                        ++hits;
+                        dySum += std::abs(got[best].y - d.y);
+                    }
+                    else
+                    {
+                        ++missed;
+                    }
+                }
+                matched += hits;
+                extra += int(got.size()) - hits;
+            }
+        }
+        logInfo("x factor", f, ":", ms, "ms/frame, speedup", fullMs / ms, "matched", matched, "missed", missed, "extra", extra,
+                "mean |dy|", matched ? dySum / matched : 0.0);
+    }
 }
+
+auto checkBinaryPerf(std::string imgPath, std::string templatePath, float threshold) -> void
+{
+    cv::Mat m = cv::imread(imgPath);
+    cv::Mat tmp = cv::imread(templatePath, cv::IMREAD_UNCHANGED);
+    if (m.empty() || tmp.empty())
+    {
+        logError("checkBinaryPerf: could not read", imgPath, templatePath);
+        return;
+    }
+    cv::Mat grayScreen;
+    cv::cvtColor(m, grayScreen, cv::COLOR_BGR2GRAY);
+    PreparedTemplate templ{tmp};
+    // production scale: the frame is matched at 373 px width
+    double matchScale = 373.0 / grayScreen.cols;
+    cv::resize(grayScreen, grayScreen, cv::Size(), matchScale, matchScale, cv::INTER_NEAREST);
+    auto regions = splitLanes(grayScreen.size());
+    const int templHeight = templ[LANE_UP].gray.rows;
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    auto elapsedMs = [&]
+    { return static_cast<double>(end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart; };
+    std::array<std::vector<Detection>, LANE_COUNT> cvDetections, binDetections;
+    for (int j = 0; j < 10; j++)
+    {
+        QueryPerformanceCounter(&start);
+        for (int i = 0; i < LANE_COUNT; i++)
+        {
+            auto res = matchTemplateInRegion(grayScreen, templ[i].gray, regions[i]);
+            cvDetections[i] = getLocationDetections(rowPeaksFromResult(res, threshold), templHeight, grayScreen.rows);
+        }
+        QueryPerformanceCounter(&end);
+        double cvTime = elapsedMs();
+
+        QueryPerformanceCounter(&start);
+        for (int i = 0; i < LANE_COUNT; i++)
+        {
+            auto res = matchBinaryInRegion(grayScreen, templ[i], regions[i]);
+            binDetections[i] = getLocationDetections(rowPeaksFromResult(res, threshold), templHeight, grayScreen.rows);
+        }
+        QueryPerformanceCounter(&end);
+        logInfo("Iteration: ", j, "matchTemplate 4 lanes:", cvTime, "ms", "binary 4 lanes:", elapsedMs(), "ms");
+    }
+    int total = 0, found = 0, binTotal = 0;
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        total += int(cvDetections[i].size());
+        binTotal += int(binDetections[i].size());
+        for (const auto &d : cvDetections[i])
+        {
+            found += std::any_of(binDetections[i].begin(), binDetections[i].end(), [&](const Detection &b)
+                                 { return std::abs(b.y - d.y) <= 2; });
+        }
+    }
+    logInfo("detections - matchTemplate:", total, "binary:", binTotal, "reproduced:", found);
+}
\ No newline at end of file
@@ -2,6 +2,115 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
 #include <vector>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include "Detection.h"
+
+/**
+ * @brief Lane indices in the order the lanes appear on screen.
+ */
+enum Lane
+{
+    LANE_LEFT = 0,
+    LANE_DOWN,
+    LANE_UP,
+    LANE_RIGHT,
+    LANE_COUNT
+};
+
+/**
+ * @brief Integral statistics of a grayscale frame.
+ *
+ * Computed once per frame and shared by every lane correlation, so the image-side
+ * normalization of TM_CCOEFF_NORMED is not recomputed for each lane strip.
+ */
+struct FrameStats
+{
+    cv::Mat sum;   ///< CV_32S integral image, (rows+1)x(cols+1)
+    cv::Mat sqsum; ///< CV_64F integral of squared pixels, (rows+1)x(cols+1)
+};
+
+/**
+ * @brief Number of sample points of the sparse matcher per template rotation.
+ */
+constexpr int SPARSE_SAMPLE_POINTS = 256;
+
+/**
+ * @brief One grayscale rotation of a template with its precomputed statistics.
+ */
+struct TemplateRotation
+{
+    cv::Mat gray;            ///< 8-bit grayscale template
+    cv::Mat zeroMean;        ///< CV_32F template minus its mean
+    cv::Mat widened;         ///< CV_16S template, rows padded to 32 elements (64-byte aligned rows) for the SIMD kernel
+    int64_t sum = 0;         ///< Sum of the pixels
+    int64_t sqSum = 0;       ///< Sum of the squared pixels
+    double mean = 0;         ///< Mean of the pixels
+    double norm = 0;         ///< L2 norm of zeroMean
+    cv::Mat spectrum;        ///< Optional CCS spectrum of zeroMean padded to spectrumSize
+    cv::Size spectrumSize{}; ///< DFT size the spectrum was computed for
+    cv::Mat mask;            ///< Optional 8-bit alpha of the template, empty for opaque templates
+    std::vector<cv::Point> samples;   ///< Sparse sample points: opaque, high-gradient pixels in raster order
+    std::vector<float> sampleWeights; ///< Template values at samples minus their mean
+    double sampleNorm = 0;            ///< L2 norm of sampleWeights
+    std::vector<uint64_t> bits;       ///< Otsu binarized template, rows of bitWords words, bit i of a word is pixel 64*w+i
+    std::vector<uint64_t> bitMask;    ///< Bits compared by the binary matcher: opaque pixels inside the template
+    int bitWords = 0;                 ///< 64-bit words per template row
+    int bitCount = 0;                 ///< Number of set bits of bitMask
+    int bitOnes = 0;                  ///< Number of set bits of bits under bitMask
+
+    auto size() const -> cv::Size { return gray.size(); }
+};
+
+/**
+ * @brief Canonical template representation shared by every matching engine.
+ *
+ * Holds the four lane rotations of the arrow template with their mean, norm,
+ * zero-mean copy and aligned widened buffer, computed once instead of on every match.
+ */
+class PreparedTemplate
+{
+public:
+    PreparedTemplate() = default;
+
+    /**
+     * @brief Prepares the lane rotations of an up-arrow template.
+     *
+     * @param upTemplate The up-arrow template (gray, BGR or BGRA). The alpha of BGRA
+     *                   templates limits the sparse sample points to opaque pixels.
+     */
+    explicit PreparedTemplate(const cv::Mat &upTemplate);
+
+    /**
+     * @brief Computes the DFT spectra of all rotations for the given DFT size.
+     *
+     * Does nothing for rotations that already hold a spectrum of that size.
+     */
+    auto prepareSpectra(cv::Size dftSize) -> void;
+
+    /**
+     * @brief Returns a copy with every rotation resized by fx, fy (INTER_AREA).
+     *
+     * Resizing after rotation lets lane strips be scaled anisotropically in screen space.
+     */
+    auto resized(double fx, double fy) const -> PreparedTemplate;
+
+    auto operator[](int lane) const -> const TemplateRotation & { return rotations[lane]; }
+    auto empty() const -> bool { return rotations[LANE_UP].gray.empty(); }
+
+private:
+    std::array<TemplateRotation, LANE_COUNT> rotations;
+};
+
+/**
+ * @brief Prepares the statistics and buffers of a single grayscale template.
+ *
+ * @param gray The 8-bit grayscale template.
+ * @param mask Optional 8-bit alpha; sparse sample points are taken from opaque pixels only.
+ * @return The prepared template rotation.
+ */
+auto prepareRotation(const cv::Mat &gray, const cv::Mat &mask = cv::Mat()) -> TemplateRotation;
 
 /**
  * @brief Matches a template within a specified region of an image.
@@ -16,6 +125,569 @@
  */
 auto matchTemplateInRegion(const cv::Mat &img, const cv::Mat &templ, cv::Rect region, int method = cv::TM_CCOEFF_NORMED)->cv::Mat;
 
+/**
+ * @brief Matches a prepared template within a region with cv::TM_CCOEFF_NORMED.
+ *
+ * Uses the cached template mean and norm instead of recomputing them on every call.
+ *
+ * @param img The 8-bit grayscale source image.
+ * @param templ The prepared template rotation.
+ * @param region The region of the source image to search within.
+ * @return A CV_32F cv::Mat with the TM_CCOEFF_NORMED scores.
+ */
+auto matchTemplateInRegion(const cv::Mat &img, const TemplateRotation &templ, cv::Rect region) -> cv::Mat;
+
+/**
+ * @brief Sparse TM_CCOEFF_NORMED: correlates only the sample points of the template.
+ *
+ * Windows are scored by the normalized correlation of the image pixels at templ.samples
+ * with templ.sampleWeights, so transparent background and flat areas of the template cost
+ * nothing. Sample offsets are precomputed per image row stride and 8 windows are scored
+ * at once with AVX2 where available.
+ *
+ * @param img The 8-bit grayscale source image.
+ * @param templ The prepared template rotation.
+ * @param region The region of the source image to search within.
+ * @return A CV_32F cv::Mat with the scores, laid out like a cv::matchTemplate result.
+ */
+auto matchSparseInRegion(const cv::Mat &img, const TemplateRotation &templ, cv::Rect region) -> cv::Mat;
+
+/**
+ * @brief Binarized matching: POPCNT correlation of Otsu bitplanes.
+ *
+ * The region is binarized with Otsu and packed 64 pixels per word; every window is compared
+ * with the template bitplane under its opaque mask. The score is the phi coefficient of the
+ * two bitplanes, the binary TM_CCOEFF_NORMED: it is computed from the set bits of the
+ * template, of the window and of both, so it is 1 for identical bitplanes and 0 for
+ * unrelated ones or a flat window, whatever the balance of set bits in the template.
+ *
+ * @param img The 8-bit grayscale source image.
+ * @param templ The prepared template rotation.
+ * @param region The region of the source image to search within.
+ * @return A CV_32F cv::Mat with the scores, laid out like a cv::matchTemplate result.
+ */
+auto matchBinaryInRegion(const cv::Mat &img, const TemplateRotation &templ, cv::Rect region) -> cv::Mat;
+
+/**
+ * @brief A thresholded template match.
+ *
+ * x and y are the top-left corner of the matched window relative to the searched region,
+ * i.e. the same coordinates as in a cv::matchTemplate result map.
+ */
+struct MatchPeak
+{
+    int y;       ///< Row of the window in the region
+    int x;       ///< Column of the window in the region
+    float score; ///< TM_CCOEFF_NORMED score
+};
+
+/**
+ * @brief Instruction set levels of the NCC peak kernel, selected at runtime.
+ */
+enum SimdLevel
+{
+    SIMD_SCALAR = 0,
+    SIMD_SSE42,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+/**
+ * @brief Returns the best SIMD level supported by the CPU and the OS (queried once).
+ */
+auto detectSimdLevel() -> SimdLevel;
+
+/**
+ * @brief Returns a printable name of a SIMD level.
+ */
+auto simdLevelName(SimdLevel level) -> const char *;
+
+/**
+ * @brief Computes the integral statistics of a grayscale frame.
+ *
+ * @param gray The 8-bit grayscale frame.
+ * @return FrameStats holding the integral and squared integral images.
+ */
+auto computeFrameStats(const cv::Mat &gray) -> FrameStats;
+
+/**
+ * @brief Splits the frame into the lane regions used for matching.
+ *
+ * Every lane is a quarter of the frame wide; regions are clamped to the frame.
+ *
+ * @param frameSize The size of the frame.
+ * @return The lane regions in Lane order.
+ */
+auto splitLanes(cv::Size frameSize) -> std::array<cv::Rect, LANE_COUNT>;
+
+/**
+ * @brief Matches the lane templates in their lane regions in one call.
+ *
+ * The frame integral statistics are computed once and shared by the four correlations.
+ * The result maps are equivalent to matchTemplateInRegion with cv::TM_CCOEFF_NORMED.
+ *
+ * @param gray The 8-bit grayscale frame.
+ * @param templ The prepared template with the lane rotations.
+ * @param regions The lane regions in Lane order (see splitLanes).
+ * @return The CV_32F result maps in Lane order.
+ */
+auto matchLanes(const cv::Mat &gray, const PreparedTemplate &templ, const std::array<cv::Rect, LANE_COUNT> &regions) -> std::array<cv::Mat, LANE_COUNT>;
+
+/**
+ * @brief Matches a template in a region and emits thresholded peaks directly.
+ *
+ * Runs an 8-bit normalized cross-correlation kernel with integer accumulation,
+ * dispatched to SSE4.2/AVX2/AVX-512 at runtime. No CV_32F result map is created;
+ * windows scoring below the threshold are dropped on the fly. Templates too large for
+ * int32 dot products (over ~33000 pixels) are scored with OpenCV's TM_CCORR instead.
+ *
+ * @param gray The 8-bit grayscale frame.
+ * @param stats The integral statistics of gray (see computeFrameStats).
+ * @param templ The prepared template rotation.
+ * @param region The region of the frame to search within.
+ * @param threshold Minimum TM_CCOEFF_NORMED score of an emitted peak.
+ * @return The peaks in raster order (increasing y, then x).
+ */
+auto matchPeaksInRegion(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, cv::Rect region, float threshold) -> std::vector<MatchPeak>;
+
+/**
+ * @brief Peak variant of matchLanes: runs matchPeaksInRegion for each lane with shared frame statistics.
+ *
+ * @return The peaks of each lane in Lane order.
+ */
+auto matchLanePeaks(const cv::Mat &gray, const PreparedTemplate &templ, const std::array<cv::Rect, LANE_COUNT> &regions, float threshold) -> std::array<std::vector<MatchPeak>, LANE_COUNT>;
+
+/**
+ * @brief Minimum vertical distance between two reported locations of a lane.
+ */
+constexpr int LOCATION_DISP_Y = 17;
+
+/**
+ * @brief Computes the maximum of each of the first rows of a CV_32F result map (SIMD).
+ *
+ * @param result The result map.
+ * @param rows Number of rows to reduce; rows past the map are ignored.
+ * @return One maximum per row.
+ */
+auto rowMaxima(const cv::Mat &result, int rows) -> std::vector<float>;
+
+/**
+ * @brief Sums each row of a CV_8U image (SIMD); the vertical profile of a strip.
+ *
+ * @param img The 8-bit single channel image.
+ * @return One sum per row.
+ */
+auto rowSums(const cv::Mat &img) -> std::vector<int>;
+
+/**
+ * @brief 1-D non-maximum suppression over row maxima.
+ *
+ * Keeps the strongest row within LOCATION_DISP_Y of the previously reported one.
+ *
+ * @param maxima Row maxima of a result map (see rowMaxima).
+ * @param height Offset added to every row to turn it into a bottom Y.
+ * @param threshold Minimum score of a row.
+ * @return The bottom Y locations in increasing order.
+ */
+auto suppressRowMaxima(const std::vector<float> &maxima, int height, float threshold) -> std::vector<int>;
+
+/**
+ * @brief Gets the bottom Y locations of the matches in a result map.
+ *
+ * Reduces the rows above the exit area to their maxima with SIMD and runs
+ * suppressRowMaxima on them; equivalent to getLocationsBottomYReference.
+ *
+ * @param result The CV_32F TM_CCOEFF_NORMED result map.
+ * @param height The template height added to every row.
+ * @param exitArea Last row considered; matches below it are ignored.
+ * @param threshold Minimum score of a match.
+ * @return The bottom Y locations in increasing order.
+ */
+auto getLocationsBottomY(const cv::Mat &result, int height, int exitArea, float threshold) -> std::vector<int>;
+
+/**
+ * @brief Reference per-pixel scan of getLocationsBottomY, kept for equivalence checks.
+ */
+auto getLocationsBottomYReference(const cv::Mat &result, int height, int exitArea, float threshold) -> std::vector<int>;
+
+/**
+ * @brief 1-D non-maximum suppression of detections sorted by increasing y.
+ *
+ * A detection closer than dispY to the last kept one replaces it only if it scores higher.
+ *
+ * @param detections Candidates in increasing y.
+ * @param dispY Minimum vertical distance between two kept detections.
+ * @return The kept detections in increasing y.
+ */
+auto suppressDetections(const std::vector<Detection> &detections, int dispY = LOCATION_DISP_Y) -> std::vector<Detection>;
+
+/**
+ * @brief Gets the scored lane detections from thresholded peaks in raster order.
+ *
+ * Same selection as getLocationsBottomY, keeping the x position and score of each match.
+ *
+ * @param peaks Peaks from matchPeaksInRegion or rowPeaksFromResult.
+ * @param height The template height added to every row.
+ * @param exitArea Last row considered; peaks below it are ignored.
+ * @param dispY Minimum distance of two detections, scaled with the frame.
+ * @return The detections in increasing y.
+ */
+auto getLocationDetections(const std::vector<MatchPeak> &peaks, int height, int exitArea, int dispY = LOCATION_DISP_Y) -> std::vector<Detection>;
+
+/**
+ * @brief Gets the bottom Y locations from thresholded peaks in raster order.
+ *
+ * Same selection as getLocationsBottomY for peaks from matchPeaksInRegion or rowPeaksFromResult.
+ */
+auto getLocationsBottomY(const std::vector<MatchPeak> &peaks, int height, int exitArea) -> std::vector<int>;
+
+/**
+ * @brief Equivalence test of getLocationsBottomY against getLocationsBottomYReference on random maps.
+ *
+ * @return true if all iterations produced identical locations.
+ */
+auto checkLocationsBottomY(int iterations = 1000) -> bool;
+
+/**
+ * @brief Converts a TM_CCOEFF_NORMED result map into one peak per row (the row maximum).
+ *
+ * Only rows whose maximum reaches the threshold are emitted, in increasing y. This is all
+ * getLocationsBottomY needs, since within a row only the maximum can be selected.
+ */
+auto rowPeaksFromResult(const cv::Mat &result, float threshold) -> std::vector<MatchPeak>;
+
+/**
+ * @brief Correlation engines of LaneMatcher.
+ */
+enum MatchEngine
+{
+    MATCH_ENGINE_AUTO = 0, ///< Pick spatial or FFT per lane from the calibrated cost model
+    MATCH_ENGINE_OPENCV,   ///< cv::matchTemplate TM_CCORR with shared normalization
+    MATCH_ENGINE_SPATIAL,  ///< SIMD integer kernel (matchPeaksInRegion)
+    MATCH_ENGINE_FFT,      ///< DFT correlation with cached template spectra
+    MATCH_ENGINE_SPARSE,   ///< NCC over the sparse sample points only (matchSparseInRegion)
+    MATCH_ENGINE_BINARY,   ///< Correlation of binarized bitplanes (matchBinaryInRegion)
+    MATCH_ENGINE_BLOB      ///< Background-model blobs, correlation only for ambiguous ones (BlobDetector)
+};
+
+/**
+ * @brief Returns a printable name of a match engine.
+ */
+auto matchEngineName(MatchEngine engine) -> const char *;
+
+/**
+ * @brief Per-operation costs measured by calibrateMatchCost, in nanoseconds.
+ */
+struct MatchCostModel
+{
+    double spatialPerMac = 0; ///< Spatial kernel cost per window pixel multiply-accumulate
+    double fftPerPoint = 0;   ///< FFT correlation cost per N*log2(N) of the DFT size
+};
+
+/**
+ * @brief Micro-benchmarks the spatial and FFT engines on a synthetic lane strip.
+ *
+ * @param templ The template rotation used for the measurement.
+ * @return The calibrated cost model.
+ */
+auto calibrateMatchCost(const TemplateRotation &templ) -> MatchCostModel;
+
+/**
+ * @brief Picks the cheaper of the spatial and FFT engines for a strip and template size.
+ */
+auto chooseMatchEngine(const MatchCostModel &cost, cv::Size stripSize, cv::Size templSize) -> MatchEngine;
+
+/**
+ * @brief Reusable DFT state of one lane strip size.
+ *
+ * cv::dft has no explicit plans, so the plan is the optimal DFT size plus the
+ * buffers and template spectrum for it, kept across frames while the strip size holds.
+ */
+struct FftPlan
+{
+    cv::Size stripSize{};  ///< Strip size the plan was built for
+    cv::Size dftSize{};    ///< Optimal DFT size covering the strip
+    cv::Mat templSpectrum; ///< CCS spectrum of the zero-mean template
+    cv::Mat padded;        ///< CV_32F strip padded to dftSize
+    cv::Mat spectrum;      ///< Strip spectrum and product buffer
+    cv::Mat corr;          ///< Inverse transform output
+};
+
+/**
+ * @brief Matches a template in a region with FFT correlation, TM_CCOEFF_NORMED scores.
+ *
+ * The numerator comes from correlating with the zero-mean template spectrum; the
+ * image-side normalization comes from the frame integrals.
+ *
+ * @param gray The 8-bit grayscale frame.
+ * @param stats The integral statistics of gray.
+ * @param templ The prepared template rotation (spectrum reused when its size matches the plan).
+ * @param region The region of the frame to search within.
+ * @param plan The lane plan; rebuilt when the region size changes.
+ * @return A CV_32F result map (a view into plan buffers, valid until the next call).
+ */
+auto matchFftInRegion(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, cv::Rect region, FftPlan &plan) -> cv::Mat;
+
+/**
+ * @brief Finds arrow candidates as foreground blobs over a running background of each lane.
+ *
+ * Each lane strip keeps an exponential average of its background. Pixels that differ from it
+ * by more than DIFF_THRESHOLD form connected components; a component of about the template
+ * size is reported directly with score 1, any other component is confirmed by correlating
+ * the template around it. During the warm-up every blob is confirmed, so arrows that were on
+ * screen while the background was seeded do not leave ghost detections.
+ */
+class BlobDetector
+{
+public:
+    static constexpr double LEARNING_RATE = 0.05; ///< Background update rate of pixels without foreground
+    static constexpr int DIFF_THRESHOLD = 30;     ///< Minimum difference of a foreground pixel
+    static constexpr int WARMUP_FRAMES = 60;      ///< Frames before blobs are trusted without correlation
+
+    /**
+     * @brief Detects the arrows in part of one lane and updates the background of the whole lane.
+     *
+     * The background is kept for the full lane strip, so a search region narrowed e.g. by
+     * ColumnLock does not reseed it; only a change of the lane region itself does.
+     *
+     * @param gray The 8-bit grayscale frame.
+     * @param stats Integral statistics of gray, used to confirm ambiguous blobs.
+     * @param templ The template rotation of the lane.
+     * @param lane The lane index.
+     * @param laneRegion The full lane region.
+     * @param search The searched part of laneRegion.
+     * @param threshold Minimum TM_CCOEFF_NORMED score of a confirmed blob.
+     * @return Peaks relative to search in raster order, like matchPeaksInRegion.
+     */
+    auto detectLane(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, int lane, cv::Rect laneRegion, cv::Rect search, float threshold) -> std::vector<MatchPeak>;
+
+    auto reset() -> void { *this = BlobDetector{}; }
+
+private:
+    std::array<cv::Mat, LANE_COUNT> background; ///< CV_32F running average per lane strip
+    std::array<cv::Rect, LANE_COUNT> lanes{};   ///< Lane region each background was seeded for
+    std::array<int, LANE_COUNT> frames{};
+
+    /// blobs of the foreground fg of region, confirmed by correlation until warm
+    static auto findBlobs(const cv::Mat &gray, const FrameStats &stats, const TemplateRotation &templ, const cv::Mat &fg, cv::Rect region, bool warm, float threshold, std::vector<MatchPeak> &peaks) -> void;
+};
+
+/**
+ * @brief Lane matching runtime choosing and running a correlation engine per lane.
+ *
+ * Owns the prepared template, the FFT plans and the calibrated cost model. With
+ * MATCH_ENGINE_AUTO the engine of each lane is re-chosen whenever its strip size changes.
+ */
+class LaneMatcher
+{
+public:
+    LaneMatcher() = default;
+
+    /**
+     * @brief Construct a lane matcher for an up-arrow template.
+     *
+     * @param upTemplate The up-arrow template (gray, BGR or BGRA).
+     */
+    explicit LaneMatcher(const cv::Mat &upTemplate);
+
+    /**
+     * @brief Runs the startup micro-benchmark feeding the automatic engine choice.
+     *
+     * The result is cached per template size for the whole process, so only the first
+     * matcher of a size pays for the benchmark.
+     */
+    auto calibrate() -> void;
+
+    /**
+     * @brief Forces an engine for all lanes, or MATCH_ENGINE_AUTO.
+     */
+    auto setEngine(MatchEngine engine) -> void;
+
+    /**
+     * @brief Enables coarse-to-fine pyramid matching.
+     *
+     * Lanes are first matched at 1/factor scale against pre-downscaled templates with a
+     * relaxed threshold; only the neighbourhoods of those candidates are matched again
+     * at full resolution.
+     *
+     * @param factor 2 or 4; 0 or 1 disables the pyramid.
+     * @param relaxedThreshold Score a coarse candidate needs to be refined.
+     */
+    auto setPyramid(int factor, float relaxedThreshold = 0.4f) -> void;
+
+    /**
+     * @brief Enables anisotropic matching of frames downsampled by xFactor in x only.
+     *
+     * The caller decimates the frames, e.g. in the resize it does anyway; the template
+     * rotations are pre-scaled the same way. Every path (full lanes, windows, pyramid and
+     * all engines) then matches in the reduced frame, and peak x is in its pixels.
+     *
+     * @param xFactor Horizontal reduction factor; 0 or 1 disables it.
+     */
+    auto setAnisotropic(int xFactor) -> void;
+
+    /**
+     * @brief Horizontal reduction the frames must have, 1 without anisotropic matching.
+     */
+    auto anisotropicFactor() const -> int { return std::max(anisoFactor, 1); }
+
+    /**
+     * @brief Matches only row windows of each lane, e.g. tracker predictions.
+     *
+     * Windows are merged and clamped, then each is matched across the lane width with the
+     * selected engine, so windowed and full frames score on the same scale. The sparse and
+     * binary engines run their own kernels; the NCC engines (auto, OpenCV, spatial, FFT) all
+     * use the spatial kernel, which gives the same TM_CCOEFF_NORMED scores on narrow bands.
+     * The blob engine needs every full lane once per frame to keep its background, so its
+     * windows are matched with the spatial kernel too. Frame statistics are still computed
+     * once for the whole frame.
+     *
+     * @param gray The 8-bit grayscale frame.
+     * @param regions The lane regions in Lane order.
+     * @param windows Per lane, ranges of window rows (top of the match, relative to the lane region).
+     * @param threshold Minimum TM_CCOEFF_NORMED score of a peak.
+     * @return The peaks of each lane in Lane order, raster ordered, relative to the lane region.
+     */
+    auto matchPeaksInWindows(const cv::Mat &gray, const std::array<cv::Rect, LANE_COUNT> &regions, const std::array<std::vector<cv::Range>, LANE_COUNT> &windows, float threshold) const -> std::array<std::vector<MatchPeak>, LANE_COUNT>;
+
+    /**
+     * @brief matchPeaksInWindows with frame statistics computed by the caller, e.g. shared by several matchers.
+     */
+    auto matchPeaksInWindows(const cv::Mat &gray, const FrameStats &stats, const std::array<cv::Rect, LANE_COUNT> &regions, const std::array<std::vector<cv::Range>, LANE_COUNT> &windows, float threshold) const -> std::array<std::vector<MatchPeak>, LANE_COUNT>;
+
+    /**
+     * @brief Matches all lanes and returns thresholded peaks per lane.
+     *
+     * @param gray The 8-bit grayscale frame.
+     * @param regions The searched lane regions in Lane order.
+     * @param threshold Minimum TM_CCOEFF_NORMED score of a peak.
+     * @param lanes The full lane regions that regions were narrowed from, for engines keeping
+     * per-lane state (MATCH_ENGINE_BLOB); nullptr when regions are the full lanes.
+     * @return The peaks of each lane in Lane order, raster ordered.
+     */
+    auto matchPeaks(const cv::Mat &gray, const std::array<cv::Rect, LANE_COUNT> &regions, float threshold, const std::array<cv::Rect, LANE_COUNT> *lanes = nullptr) -> std::array<std::vector<MatchPeak>, LANE_COUNT>;
+
+    auto templates() const -> const PreparedTemplate & { return templ; }
+    auto laneEngine(int lane) const -> MatchEngine { return laneEngines[lane]; }
+
+    /**
+     * @brief Time each lane took in the last matchPeaks or matchPeaksInWindows, in ms.
+     */
+    auto laneTimesMs() const -> const std::array<double, LANE_COUNT> & { return laneMs; }
+
+private:
+    /**
+     * @brief Coarse-to-fine match of one lane; peaks relative to the lane region.
+     */
+    auto matchLanePyramid(const cv::Mat &gray, const FrameStats &stats, const cv::Mat &coarse, const FrameStats &coarseStats, int lane, cv::Rect region, float threshold) -> std::vector<MatchPeak>;
+
+    PreparedTemplate templ;
+    PreparedTemplate coarseTempl; ///< templ downscaled by pyramidFactor
+    int pyramidFactor = 0;
+    float pyramidThreshold = 0.4f;
+    PreparedTemplate uniformTempl; ///< templ before the x reduction of anisotropic matching
+    int anisoFactor = 0;
+    MatchCostModel cost;
+    MatchEngine engine = MATCH_ENGINE_AUTO;
+    std::array<FftPlan, LANE_COUNT> plans;
+    std::array<cv::Size, LANE_COUNT> laneSizes{};
+    std::array<MatchEngine, LANE_COUNT> laneEngines{};
+    BlobDetector blobs;
+    mutable std::array<double, LANE_COUNT> laneMs{}; ///< Written by the const windowed path too
+};
+
+/**
+ * @brief Learns the arrow column of a lane and narrows the horizontal search to it.
+ *
+ * Arrows of a lane always sit at the same x. After enough confident detections agree on
+ * a column, restrict() returns a band of a few pixels around it instead of the whole strip.
+ * The lock is dropped when only weak matches are seen for a while, or nothing at all.
+ */
+class ColumnLock
+{
+public:
+    static constexpr int BAND = 3;             ///< Default allowed x deviation around the locked column
+    static constexpr int LOCK_VOTES = 5;       ///< Agreeing confident detections needed to lock
+    static constexpr int DEGRADED_FRAMES = 5;  ///< Consecutive frames with only weak matches before unlocking
+    static constexpr int EMPTY_FRAMES = 60;    ///< Consecutive frames without any match before unlocking
+
+    /**
+     * @brief Creates a lock allowing band pixels of x deviation around the column.
+     */
+    explicit ColumnLock(int band = BAND) : band{band} {}
+
+    /**
+     * @brief Feeds the detections of one frame, with x relative to the full lane region.
+     *
+     * @param detections The lane detections of the frame.
+     * @param confidentScore Score a detection needs to vote for a column.
+     */
+    auto observe(const std::vector<Detection> &detections, float confidentScore) -> void;
+
+    /**
+     * @brief Narrows a lane region to the locked column, or returns it unchanged.
+     *
+     * @param region The full lane region.
+     * @param templWidth Width of the matched template.
+     */
+    auto restrict(cv::Rect region, int templWidth) const -> cv::Rect;
+
+    auto locked() const -> bool { return votes >= LOCK_VOTES; }
+    auto reset() -> void { *this = ColumnLock{band}; }
+
+private:
+    int band = BAND;
+    int column = -1;
+    int votes = 0;
+    int weakFrames = 0;
+    int emptyFrames = 0;
+};
+
+/**
+ * @brief Estimates the global vertical scroll between consecutive frames.
+ *
+ * All arrows of a song move at the same speed, so one displacement describes every lane.
+ * Each lane strip is collapsed into its row profile, the slowly learned static part of the
+ * profile is removed, and the profiles of two frames are aligned with 1-D phase correlation.
+ * The cross-power spectra of all lanes are summed before whitening, so lanes without arrows
+ * add little and the shared displacement stands out.
+ */
+class ScrollEstimator
+{
+public:
+    static constexpr int MAX_SHIFT = 48;             ///< Default largest displacement per frame, in pixels
+    static constexpr float MIN_RESPONSE = 0.15f;     ///< Minimum phase correlation peak of a valid estimate
+    static constexpr float BACKGROUND_RATE = 0.05f;  ///< Update rate of the static profile
+
+    /**
+     * @brief Creates an estimator searching displacements up to maxShift pixels per frame.
+     */
+    explicit ScrollEstimator(int maxShift = MAX_SHIFT) : maxShift{maxShift} {}
+
+    /**
+     * @brief Feeds a frame and estimates its displacement from the previous one.
+     *
+     * @param gray The 8-bit grayscale frame.
+     * @param strips The lane regions, any number of them; they should keep their height between frames.
+     * @return Displacement in pixels, positive when content moves down, or nothing when
+     * there is no previous frame or the correlation peak is too weak.
+     */
+    auto estimate(const cv::Mat &gray, const std::vector<cv::Rect> &strips) -> std::optional<float>;
+
+    /**
+     * @brief Phase correlation peak of the last estimate, in [0, 1].
+     */
+    auto response() const -> float { return lastResponse; }
+
+    auto reset() -> void { *this = ScrollEstimator{maxShift}; }
+
+private:
+    int maxShift; ///< Largest displacement searched, MAX_SHIFT scaled with the frame
+    std::vector<std::vector<float>> background; ///< Running average of each lane profile
+    std::vector<cv::Mat> previous;              ///< Spectrum of each lane profile in the previous frame
+    float lastResponse = 0;
+};
+
 /**
  * @brief Detects lines of an image.
  * 
@@ -82,8 +754,53 @@ auto detectBorder(const cv::Mat &screen, int minLineLength=100) -> std::optional
  */
 auto LoadMatFromResource(HINSTANCE hInstance, LPCSTR resourceName, LPCSTR resourceType) -> cv::Mat;
 
+/**
+ * @brief Loads the up-arrow template variants of a directory.
+ *
+ * Every .png of the directory is read unchanged, so alpha is kept, in file name order.
+ *
+ * @param dir The directory; a missing directory yields no variants.
+ * @return The loaded templates.
+ */
+auto loadTemplateVariants(const std::string &dir) -> std::vector<cv::Mat>;
+
 
 /**
  * @brief Bench: Matches a template within a specified region of an image.
  */
-auto checkOpenCvPerf(std::string imgPath, std::string templatePath ) -> void;
\ No newline at end of file
+auto checkOpenCvPerf(std::string imgPath, std::string templatePath ) -> void;
+
+/**
+ * @brief Bench: Matches a prepared template in the four lanes of an image.
+ *
+ * Times cv::matchTemplate with TM_CCOEFF_NORMED as the reference, then matchTemplateInRegion
+ * and matchLanes, and logs their speedup and largest score difference from the reference.
+ */
+auto checkOpenCvPerf(std::string imgPath, const PreparedTemplate &templ) -> void;
+
+/**
+ * @brief Bench: SIMD NCC peak kernel against matchTemplateInRegion at the production match scale.
+ */
+auto checkSimdNccPerf(std::string imgPath, std::string templatePath, float threshold = 0.55f) -> void;
+
+/**
+ * @brief Bench: anisotropic x factors against full resolution matching on recorded frames.
+ *
+ * Every .png/.jpg frame of the directory is scaled to the production width and matched at
+ * full resolution and, decimated in x like the preprocess stage does, at each x factor. Logs the time per frame and, against the full
+ * resolution detections, matched/missed/extra counts and the mean y error of matched ones.
+ *
+ * @param framesDir Directory with recorded screen frames.
+ * @param templatePath Path of the up-arrow template.
+ * @param xFactors The x factors to compare.
+ * @param threshold Minimum score of a detection.
+ */
+auto checkAnisotropicAccuracy(std::string framesDir, std::string templatePath, const std::vector<int> &xFactors = {2, 3, 4}, float threshold = 0.55f) -> void;
+
+/**
+ * @brief Bench: binarized popcount matcher against the cv::matchTemplate path on the same frame.
+ *
+ * Logs the time of both for all four lanes and how many cv::matchTemplate detections the
+ * binary matcher reproduces within 2 rows.
+ */
+auto checkBinaryPerf(std::string imgPath, std::string templatePath, float threshold = 0.55f) -> void;
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include "donRaulAva.h"
 #include "DetectLoop.h"
+#include "Detector.h"
 #include <opencv2/core/ocl.hpp>
 #include "NaiveTracker.h"
 // Global Variables:
@@ -98,7 +99,9 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
         MessageBoxA(NULL, "Another instance of this program is already running.", "Warning", MB_OK | MB_ICONWARNING);
         return 0;
     }
-    LogToFile::getInstance().setVerboseLevel(getFirstCommandLineArgAsInt());
+    // verbosity: --verbose=<level>, or the first argument that is not an option
+    auto verbose = getCommandLineOption("verbose");
+    LogToFile::getInstance().setVerboseLevel(verbose.empty() ? getFirstCommandLineArgAsInt() : safeStoiDefault(verbose, 0));
 
     logInfo("Starting DonRaulito");
     // check();
@@ -132,6 +135,38 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     }
 
     detectLoop.setTrackObj(LoadMatFromResource(hInstance, MAKEINTRESOURCEA(IDR_TMPL_PNG), "PNG"));
+    // arrow art of other skins: --templates=<dir>, by default the templates folder
+    auto templatesDir = getCommandLineOption("templates");
+    detectLoop.setTemplateVariants(loadTemplateVariants(templatesDir.empty() ? "templates" : templatesDir));
+    // --lanes=<layout> for charts with other lanes, see LaneLayout::parse
+    if (auto lanes = getCommandLineOption("lanes"); !lanes.empty())
+    {
+        if (auto layout = LaneLayout::parse(lanes))
+        {
+            detectLoop.setLaneLayout(*layout);
+        }
+        else
+        {
+            logError("Invalid lane layout", lanes);
+        }
+    }
+    // --cores=<list> and --scheduling=<class> place the detection, capture and input threads,
+    // overriding only the given config field; e.g. --cores=2,3 --scheduling=high
+    auto cores = getCommandLineOption("cores");
+    auto scheduling = getCommandLineOption("scheduling");
+    if (!cores.empty() || !scheduling.empty())
+    {
+        auto coreMask = cores.empty() ? std::nullopt : parseCoreList(cores);
+        auto schedulingClass = scheduling.empty() ? std::nullopt : parseScheduling(scheduling);
+        if ((cores.empty() || coreMask) && (scheduling.empty() || schedulingClass))
+        {
+            detectLoop.setThreadPlacement(coreMask, schedulingClass);
+        }
+        else
+        {
+            logError("Invalid thread placement", cores, scheduling);
+        }
+    }
     detectLoop.start();
 
     // Create the window
@@ -145,6 +180,20 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
         return 1;
     }
 
+    // --detector=<name> overrides the detector chosen in the config
+    if (auto name = getCommandLineOption("detector"); !name.empty())
+    {
+        int index = DetectorRegistry::instance().indexOf(name);
+        if (index >= 0)
+        {
+            detectLoop.setDetector(index);
+        }
+        else
+        {
+            logError("Unknown detector", name);
+        }
+    }
+
     ShowWindow(hWnd, nCmdShow);
     // Show the window
 
@@ -185,6 +234,7 @@ WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         glInstance = (HINSTANCE)GetWindowLongPtr(hWnd, GWLP_HINSTANCE);
         config = new ConfigDialog(glInstance, hWnd);
         config->setParentCallBackMSG(WM_CONFIG_USER);
+        detectLoop.setDetector(config->DetectorIndex());
         ChangeSkin(hWnd, glInstance, config->UISkin());
         currentBitmap = bitmap;
     }
@@ -275,6 +325,8 @@ WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         {
             bool useGlow = currentBitmap == glowBitmap;
             ChangeSkin(hWnd, glInstance, config->UISkin(), useGlow);
+            // swapped on the next frame, even while running
+            detectLoop.setDetector(config->DetectorIndex());
             // save current bitmap state
             currentBitmap = useGlow ? glowBitmap : bitmap;
         }
@@ -11,6 +11,7 @@
 #define IDC_EDIT6                       1008
 #define IDC_COMBO1                      1098
 #define IDC_COMBO2                      1099
+#define IDC_COMBO3                      1100
 #define IDC_STATIC                      -1
 
 #define  IDC_RESET                        1009
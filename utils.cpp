@@ -315,9 +315,56 @@ auto getFirstCommandLineArgAsInt() -> int
     int nArgs;
 
     szArglist = CommandLineToArgvW(GetCommandLineW(), &nArgs);
-    if (nullptr != szArglist && nArgs > 1)
+    for (int i = 1; szArglist && i < nArgs; i++)
     {
-        result = safeStoiDefault(szArglist[1], 0);
+        std::wstring arg = szArglist[i];
+        if (arg.rfind(L"--", 0) == 0)
+        {
+            // all options take a value: --name value also skips the value
+            if (arg.find(L'=') == std::wstring::npos)
+            {
+                i++;
+            }
+            continue;
+        }
+        result = safeStoiDefault(arg, 0);
+        break;
+    }
+    if (szArglist) LocalFree(szArglist);
+
+    return result;
+}
+
+auto getCommandLineOption(const std::string &name) -> std::string
+{
+    std::string result;
+    LPWSTR *szArglist;
+    int nArgs;
+
+    szArglist = CommandLineToArgvW(GetCommandLineW(), &nArgs);
+    const std::wstring option = L"--" + std::wstring(name.begin(), name.end());
+    for (int i = 1; szArglist && i < nArgs; i++)
+    {
+        std::wstring arg = szArglist[i];
+        std::wstring value;
+        if (arg.rfind(option + L"=", 0) == 0)
+        {
+            value = arg.substr(option.size() + 1);
+        }
+        else if (arg == option && i + 1 < nArgs)
+        {
+            value = szArglist[i + 1];
+        }
+        else
+        {
+            continue;
+        }
+        // option values are plain ASCII names
+        for (auto c : value)
+        {
+            result.push_back(static_cast<char>(c));
+        }
+        break;
     }
     if (szArglist) LocalFree(szArglist);
 
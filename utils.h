@@ -222,7 +222,13 @@ void logInfo(Args &&...args)
 }
 
 /**
- * @brief Get the first command line argument as an integer.
+ * @brief Get the first command line argument that is not a --name=value or --name value option as an integer.
  * return 0 if no argument or invalid argument
  */
 auto getFirstCommandLineArgAsInt() -> int;
+
+/**
+ * @brief Get the value of a command line option given as --name=value or --name value.
+ * return an empty string if the option is not present
+ */
+auto getCommandLineOption(const std::string &name) -> std::string;